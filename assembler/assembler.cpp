@@ -6,90 +6,301 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 #include "assembler.h"
 #include "labels.h"
+#include "lines.h"
 
-static FILE *open_src(const char *filename, struct code *code);
-static void translate_src(FILE *src, struct code *code);
-int parse_cmd(const char *cmd);
-static void insert_cmd(FILE *src, struct code *code,
+static void open_src(const char *filename, struct source *src);
+static void close_src(struct source *src);
+static void insert_cmd(struct source *src, struct code *code,
+                struct labels *labels, char opcode, int flags);
+static int insert_fused_cmd(struct source *src, struct code *code,
                 struct labels *labels, char opcode);
 static FILE *create_bin(void);
-static void write_bin(FILE *bin, struct code *code);
 
 static void insert_cmd_no_arg(struct code *code, char opcode);
-static void insert_cmd_push(FILE *src, struct code *code, char opcode);
-static void insert_cmd_jmp(FILE *src, struct code *code,
+static void insert_cmd_push(struct source *src, struct code *code,
+                char opcode);
+static void insert_cmd_jmp(struct source *src, struct code *code,
                 struct labels *labels, char opcode);
+static void insert_cmd_pop(struct source *src, struct code *code);
+static int insert_operand(struct source *src, struct code *code,
+                char reg_op, char mem_op);
+static int read_reg(const char *name, int len);
+static int read_mem(const char *str, int len, int *reg, int32_t *disp);
+static void insert_jmp_arg(struct source *src, struct code *code,
+                struct labels *labels);
+static double read_arg(struct source *src);
+static int64_t read_int_arg(struct source *src);
+static void read_number(struct source *src, double *arg, int64_t *iarg);
 
-static struct cmd_desc cmds[] = {CMD_HLT, "hlt", CMD_PUSH, "push",
+static constexpr struct cmd_desc cmds[] = {CMD_HLT, "hlt", CMD_PUSH, "push",
         CMD_ADD, "add", CMD_SUB, "sub", CMD_MUL, "mul", CMD_DIV, "div",
         CMD_OUT, "out", CMD_IN, "in", CMD_SQRT, "sqrt", CMD_SIN, "sin",
         CMD_COS, "cos", CMD_JMP, "jmp", CMD_JA, "ja", CMD_JAE, "jae",
-        CMD_JB, "jb", CMD_JBE, "jbe", CMD_JE, "je", CMD_JNE, "jne"};
+        CMD_JB, "jb", CMD_JBE, "jbe", CMD_JE, "je", CMD_JNE, "jne",
+        CMD_SINCOS, "sincos", CMD_IPUSH, "ipush", CMD_IADD, "iadd",
+        CMD_ISUB, "isub", CMD_IMUL, "imul", CMD_IDIV, "idiv", CMD_IJA, "ija",
+        CMD_IJAE, "ijae", CMD_IJB, "ijb", CMD_IJBE, "ijbe", CMD_IJE, "ije",
+        CMD_IJNE, "ijne", CMD_ITOF, "itof", CMD_FTOI, "ftoi",
+        CMD_POP_REG, "pop"};
 
-static const size_t ncmds = sizeof(cmds)/sizeof(cmds[0]);
+static constexpr int ncmds = sizeof(cmds)/sizeof(cmds[0]);
 
-void run_assembler(const char *filename)
+/*
+ * Mnemonics are looked up through a perfect hash of their first, second
+ * and last two characters and their length (ijae and ijbe differ only
+ * in the next to last one). The multipliers were searched
+ * for so that every mnemonic gets a slot of its own; the table is built
+ * at compile time and the static_assert below fails if a new mnemonic
+ * collides, in which case new multipliers are needed.
+ */
+static const int cmd_hash_size = 128;
+
+static constexpr unsigned cmd_hash(const char *name, int len)
+{
+        return ((unsigned char) name[0] + (unsigned char) name[1] +
+                        2 * (unsigned char) name[len - 1] +
+                        7 * (unsigned char) name[len - 2] + len) %
+                cmd_hash_size;
+}
+
+static constexpr int cmd_name_len(const char *name)
+{
+        int len = 0;
+        while (name[len])
+                ++len;
+        return len;
+}
+
+struct cmd_table {
+        signed char index[cmd_hash_size];     /* into cmds, -1 if empty */
+        int collisions;
+};
+
+static constexpr struct cmd_table make_cmd_table(void)
+{
+        struct cmd_table table = {};
+        for (int i = 0; i < cmd_hash_size; ++i)
+                table.index[i] = -1;
+
+        for (int i = 0; i < ncmds; ++i) {
+                int len = cmd_name_len(cmds[i].name);
+                if (len < 2) {
+                        ++table.collisions;
+                        continue;
+                }
+                unsigned slot = cmd_hash(cmds[i].name, len);
+                if (table.index[slot] >= 0)
+                        ++table.collisions;
+                table.index[slot] = i;
+        }
+        return table;
+}
+
+static constexpr struct cmd_table cmd_table = make_cmd_table();
+
+static_assert(cmd_table.collisions == 0,
+                "mnemonics collide in cmd_hash, pick new multipliers");
+
+/* nthreads > 1 splits big sources across threads, see parallel.cpp */
+void run_assembler(const char *filename, int flags, int nthreads)
 {
+        struct source src = {};
+        open_src(filename, &src);
+
+        if (nthreads > 1) {
+                assemble_parallel(&src, filename, flags, nthreads);
+                close_src(&src);
+                return;
+        }
+
         struct code code = {};
-        code.ptr = code.code;
+        code_reserve(&code, 4096);
 
-        FILE *src = open_src(filename, &code);
-        translate_src(src, &code);
-        fclose(src);
+        struct labels labels = {};
+        labels_ctor(&labels, 16);
+        struct lines lines = {};
+        if (flags & ASM_DEBUG)
+                lines_ctor(&lines, filename);
 
-        FILE *bin = create_bin();
-        write_bin(bin, &code);
-        fclose(bin);
+        translate_src(&src, &code, &labels,
+                        (flags & ASM_DEBUG) ? &lines : NULL, flags);
+        labels_resolve(&labels, &labels, code.code);
+        labels_dtor(&labels);
+        close_src(&src);
+
+        write_bin(&code, 1, (flags & ASM_DEBUG) ? &lines : NULL);
+        lines_dtor(&lines);
+        free(code.code);
 }
 
-static FILE *open_src(const char *filename, struct code *code)
+/* the source is mapped rather than read, an empty file maps to nothing */
+static void open_src(const char *filename, struct source *src)
 {
-        FILE *src = fopen(filename, "r");
-        if (!src) {
+        int fd = open(filename, O_RDONLY);
+        struct stat st = {};
+        if (fd < 0 || fstat(fd, &st) < 0) {
                 fprintf(stderr, "error: couldn't open file\n");
                 exit(1);
         }
-        return src;
+
+        src->data = NULL;
+        src->size = st.st_size;
+        if (src->size) {
+                void *data = mmap(NULL, src->size, PROT_READ, MAP_PRIVATE,
+                                fd, 0);
+                if (data == MAP_FAILED) {
+                        fprintf(stderr, "error: couldn't map file\n");
+                        exit(1);
+                }
+                madvise(data, src->size, MADV_SEQUENTIAL);
+                src->data = (const char *) data;
+        }
+        close(fd);
+
+        src->ptr = src->data;
+        src->end = src->data + src->size;
 }
 
-static void translate_src(FILE *src, struct code *code)
+static void close_src(struct source *src)
 {
-        const int cmdlen = 10;
-        char cmd[cmdlen] = {};
+        if (src->data)
+                munmap((void *) src->data, src->size);
+        src->data = NULL;
+        src->ptr = src->end = NULL;
+}
 
-        struct labels labels = {};
-        labels_ctor(&labels, 10);
-        labels_find(src, &labels);
-        labels_dump(&labels);
+/*
+ * One pass over the source: labels are defined as they are met, jumps to
+ * labels further down are left in labels as references to be resolved
+ * by labels_resolve() once the whole source is read. With a line table
+ * every instruction that is not fused into the one before is entered at
+ * its line, counted from the start of src.
+ */
+void translate_src(struct source *src, struct code *code,
+                struct labels *labels, struct lines *lines, int flags)
+{
+        src->line_ptr = src->ptr;
+        src->line = 1;
 
-        while (fscanf(src, "%s", cmd) == 1) {
+        const char *cmd = NULL;
+        int len = 0;
+        while ((cmd = next_token(src, &len))) {
                 char opcode = 0;
-                if ((opcode = parse_cmd(cmd)) >= 0) {
-                        insert_cmd(src, code, &labels, opcode);
+                if ((opcode = parse_cmd(cmd, len)) >= 0) {
+                        size_t start = code->ptr - code->code;
+                        insert_cmd(src, code, labels, opcode, flags);
+                        if (lines && code->last == code->code + start)
+                                lines_add(lines, start, src_line(src, cmd));
                         continue;
                 }
-                if (islabel(cmd))
+                if (islabel(cmd, len)) {
+                        label_insert(labels, cmd, len - 1,
+                                        code->ptr - code->code);
+                        if (lines)
+                                lines_label(lines, cmd, len - 1);
+                        code->last = NULL;
                         continue;
-                fprintf(stderr, "error: invalid command \"%s\"\n", cmd);
+                }
+                fprintf(stderr, "error: invalid command \"%.*s\"\n", len,
+                                cmd);
                 exit(1);
         }
 }
 
-int parse_cmd(const char *cmd)
+/* line of at, which must not be before the last position asked for */
+int src_line(struct source *src, const char *at)
 {
-        for (int i = 0; i < ncmds; ++i) {
-                if (strcmp(cmd, cmds[i].name) == 0)
-                        return cmds[i].val;
+        const char *ptr = src->line_ptr;
+        while ((ptr = (const char *) memchr(ptr, '\n', at - ptr))) {
+                ++src->line;
+                ++ptr;
+        }
+        src->line_ptr = at;
+        return src->line;
+}
+
+/* next whitespace separated token and its length, NULL at end of source */
+const char *next_token(struct source *src, int *len)
+{
+        const char *ptr = src->ptr;
+        const char *end = src->end;
+
+        while (ptr < end && isspace_src(*ptr))
+                ++ptr;
+        if (ptr == end) {
+                src->ptr = ptr;
+                return NULL;
+        }
+
+        const char *token = ptr;
+        while (ptr < end && !isspace_src(*ptr))
+                ++ptr;
+
+        src->ptr = ptr;
+        *len = ptr - token;
+        return token;
+}
+
+/* opcode for the len chars at cmd, -1 if they are no mnemonic */
+int parse_cmd(const char *cmd, int len)
+{
+        if (len < 2)
+                return -1;
+
+        int i = cmd_table.index[cmd_hash(cmd, len)];
+        if (i < 0 || cmd_name_len(cmds[i].name) != len ||
+                        memcmp(cmd, cmds[i].name, len) != 0)
+                return -1;
+        return cmds[i].val;
+}
+
+/*
+ * Superinstruction for prev followed by opcode, or -1. A sequence is only
+ * fused when no label points between its instructions, labels are defined
+ * at the offset the fused encoding gives them.
+ */
+int fuse_cmd(int prev, int opcode)
+{
+        switch (prev) {
+                case CMD_PUSH:
+                        if (opcode == CMD_ADD)
+                                return CMD_PUSH_ADD;
+                        if (opcode == CMD_MUL)
+                                return CMD_PUSH_MUL;
+                        if (opcode == CMD_JB)
+                                return CMD_PUSH_JB;
+                        break;
+                case CMD_OUT:
+                        if (opcode == CMD_HLT)
+                                return CMD_OUT_HLT;
+                        break;
+                case CMD_IPUSH:
+                        if (opcode == CMD_IADD)
+                                return CMD_IPUSH_ADD;
+                        break;
         }
         return -1;
 }
 
-static void insert_cmd(FILE *src, struct code *code, struct labels *labels,
-                char opcode)
+static void insert_cmd(struct source *src, struct code *code,
+                struct labels *labels,
+                char opcode, int flags)
 {
+        /* no instruction, fused or not, is longer than 16 bytes */
+        code_reserve(code, 16);
+
+        if ((flags & ASM_FUSE) && insert_fused_cmd(src, code, labels, opcode))
+                return;
+
+        code->last = code->ptr;
+
         switch (opcode) {
                 case CMD_HLT:
                 case CMD_ADD:
@@ -101,11 +312,26 @@ static void insert_cmd(FILE *src, struct code *code, struct labels *labels,
                 case CMD_SQRT:
                 case CMD_SIN:
                 case CMD_COS:
+                case CMD_SINCOS:
+                case CMD_IADD:
+                case CMD_ISUB:
+                case CMD_IMUL:
+                case CMD_IDIV:
+                case CMD_ITOF:
+                case CMD_FTOI:
                         insert_cmd_no_arg(code, opcode);
                         break;
                 case CMD_PUSH:
+                        if (!insert_operand(src, code, CMD_PUSH_REG,
+                                                CMD_PUSH_MEM))
+                                insert_cmd_push(src, code, opcode);
+                        break;
+                case CMD_IPUSH:
                         insert_cmd_push(src, code, opcode);
                         break;
+                case CMD_POP_REG:
+                        insert_cmd_pop(src, code);
+                        break;
                 case CMD_JMP:
                 case CMD_JA:
                 case CMD_JAE:
@@ -113,6 +339,12 @@ static void insert_cmd(FILE *src, struct code *code, struct labels *labels,
                 case CMD_JBE:
                 case CMD_JE:
                 case CMD_JNE:
+                case CMD_IJA:
+                case CMD_IJAE:
+                case CMD_IJB:
+                case CMD_IJBE:
+                case CMD_IJE:
+                case CMD_IJNE:
                         insert_cmd_jmp(src, code, labels, opcode);
                         break;
                 default:
@@ -121,6 +353,25 @@ static void insert_cmd(FILE *src, struct code *code, struct labels *labels,
         }
 }
 
+/* rewrite the previous instruction into a superinstruction if possible */
+static int insert_fused_cmd(struct source *src, struct code *code,
+                struct labels *labels, char opcode)
+{
+        if (!code->last)
+                return 0;
+
+        int fused = fuse_cmd(*code->last, opcode);
+        if (fused < 0)
+                return 0;
+
+        *code->last = fused;
+        code->last = NULL;
+
+        if (cmd_is_jmp(fused))
+                insert_jmp_arg(src, code, labels);
+        return 1;
+}
+
 static void insert_cmd_no_arg(struct code *code, char opcode)
 {
         if (!code) {
@@ -132,7 +383,8 @@ static void insert_cmd_no_arg(struct code *code, char opcode)
         code->ptr += sizeof(char);
 }
 
-static void insert_cmd_push(FILE *src, struct code *code, char opcode)
+static void insert_cmd_push(struct source *src, struct code *code,
+                char opcode)
 {
         if (!code) {
                 fprintf(stderr, "error: null pointer\n");
@@ -142,13 +394,18 @@ static void insert_cmd_push(FILE *src, struct code *code, char opcode)
         memcpy(code->ptr, &opcode, sizeof(char));
         code->ptr += sizeof(char);
 
-        double arg = 0;
-        fscanf(src, "%lg", &arg);
-        memcpy(code->ptr, &arg, sizeof(double));
+        if (opcode == CMD_IPUSH) {
+                int64_t arg = read_int_arg(src);
+                memcpy(code->ptr, &arg, sizeof(int64_t));
+        } else {
+                double arg = read_arg(src);
+                memcpy(code->ptr, &arg, sizeof(double));
+        }
         code->ptr += sizeof(double);
 }
 
-static void insert_cmd_jmp(FILE *src, struct code *code, struct labels *labels, char opcode)
+static void insert_cmd_jmp(struct source *src, struct code *code,
+                struct labels *labels, char opcode)
 {
         if (!code) {
                 fprintf(stderr, "error: null pointer\n");
@@ -158,17 +415,233 @@ static void insert_cmd_jmp(FILE *src, struct code *code, struct labels *labels,
         memcpy(code->ptr, &opcode, sizeof(char));
         code->ptr += sizeof(char);
 
-        char arg[label_len] = "";
-        fscanf(src, "%s", arg);
+        insert_jmp_arg(src, code, labels);
+}
 
-        if (label_replace(code->ptr, labels, arg) < 0) {
-                int pos = atoi(arg);
-                memcpy(code->ptr, &arg, sizeof(int));
+static void insert_cmd_pop(struct source *src, struct code *code)
+{
+        if (!insert_operand(src, code, CMD_POP_REG, CMD_POP_MEM)) {
+                fprintf(stderr, "error: pop needs a register or memory "
+                                "operand\n");
+                exit(1);
         }
+}
+
+/*
+ * A register or [reg], [reg+imm], [reg-imm], [imm] operand: emits reg_op
+ * or mem_op with it and returns 1. Anything else is not consumed and
+ * gives 0. Blanks are allowed inside the brackets, not line breaks.
+ */
+static int insert_operand(struct source *src, struct code *code,
+                char reg_op, char mem_op)
+{
+        if (!code) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        const char *ptr = src->ptr;
+        while (ptr < src->end && isspace_src(*ptr))
+                ++ptr;
+        if (ptr == src->end)
+                return 0;
+
+        if (*ptr != '[') {
+                const char *save = src->ptr;
+                int len = 0;
+                const char *token = next_token(src, &len);
+                int reg = read_reg(token, len);
+                if (reg < 0) {
+                        src->ptr = save;
+                        return 0;
+                }
+                char byte = reg;
+                memcpy(code->ptr, &reg_op, sizeof(char));
+                code->ptr += sizeof(char);
+                memcpy(code->ptr, &byte, sizeof(char));
+                code->ptr += sizeof(char);
+                return 1;
+        }
+
+        const char *end = ptr;
+        while (end < src->end && *end != ']' && *end != '\n')
+                ++end;
+        if (end == src->end || *end != ']') {
+                fprintf(stderr, "error: missing ]\n");
+                exit(1);
+        }
+
+        int reg = reg_none;
+        int32_t disp = 0;
+        if (!read_mem(ptr + 1, end - ptr - 1, &reg, &disp)) {
+                fprintf(stderr, "error: invalid memory operand \"%.*s\"\n",
+                                (int) (end - ptr + 1), ptr);
+                exit(1);
+        }
+        src->ptr = end + 1;
+
+        char byte = reg;
+        memcpy(code->ptr, &mem_op, sizeof(char));
+        code->ptr += sizeof(char);
+        memcpy(code->ptr, &byte, sizeof(char));
+        code->ptr += sizeof(char);
+        memcpy(code->ptr, &disp, sizeof(int32_t));
+        code->ptr += sizeof(int32_t);
+        return 1;
+}
+
+/* index into reg_names of the len chars at name, -1 if none */
+static int read_reg(const char *name, int len)
+{
+        for (int i = 0; name && i < reg_count; ++i) {
+                if ((int) strlen(reg_names[i]) == len &&
+                                memcmp(name, reg_names[i], len) == 0)
+                        return i;
+        }
+        return -1;
+}
+
+/*
+ * The inside of brackets: a register, a register and a signed offset, or
+ * an absolute address. Absolute addresses must be in the RAM, offsets
+ * from a register only have to fit the displacement.
+ */
+static int read_mem(const char *str, int len, int *reg, int32_t *disp)
+{
+        char buf[64] = "";
+        int n = 0;
+        for (int i = 0; i < len; ++i) {
+                if (isspace_src(str[i]))
+                        continue;
+                if (n == (int) sizeof(buf) - 1)
+                        return 0;
+                buf[n++] = str[i];
+        }
+        buf[n] = '\0';
+
+        int i = 0;
+        while (i < n && buf[i] >= 'a' && buf[i] <= 'z')
+                ++i;
+        *reg = reg_none;
+        if (i) {
+                *reg = read_reg(buf, i);
+                if (*reg < 0)
+                        return 0;
+                if (i == n) {
+                        *disp = 0;
+                        return 1;
+                }
+                if (buf[i] != '+' && buf[i] != '-')
+                        return 0;
+        }
+
+        char *end = NULL;
+        long long val = strtoll(buf + i, &end, 0);
+        if (end == buf + i || *end)
+                return 0;
+        if (*reg == reg_none ? val < 0 || val >= ram_size :
+                        val < INT32_MIN || val > INT32_MAX)
+                return 0;
+        *disp = val;
+        return 1;
+}
 
+/*
+ * A label name or a literal byte offset. Labels defined above are known
+ * already, anything else (or everything, if labels are deferred) is left
+ * as a reference for labels_resolve().
+ */
+static void insert_jmp_arg(struct source *src, struct code *code,
+                struct labels *labels)
+{
+        int len = 0;
+        const char *arg = next_token(src, &len);
+        if (!arg) {
+                fprintf(stderr, "error: missing jump target\n");
+                exit(1);
+        }
+
+        int pos = labels->deferred ? -1 : label_find(labels, arg, len);
+        if (pos < 0)
+                label_ref(labels, code->ptr - code->code, arg, len);
+        memcpy(code->ptr, &pos, sizeof(int));
         code->ptr += sizeof(int);
 }
 
+/*
+ * The numeric prefix of the next token, like scanf("%lg") reads it: the
+ * rest of the token is left for the next read, and a token that does not
+ * start with a number is not consumed and gives 0.
+ */
+static double read_arg(struct source *src)
+{
+        double arg = 0;
+        read_number(src, &arg, NULL);
+        return arg;
+}
+
+/* the same for a decimal int64_t, as scanf("%lld") reads it */
+static int64_t read_int_arg(struct source *src)
+{
+        int64_t arg = 0;
+        read_number(src, NULL, &arg);
+        return arg;
+}
+
+/* strtod into arg, or strtoll into iarg if arg is NULL */
+static void read_number(struct source *src, double *arg, int64_t *iarg)
+{
+        const char *save = src->ptr;
+        int len = 0;
+        const char *token = next_token(src, &len);
+        if (!token)
+                return;
+
+        /* the source is not zero-terminated, strtod needs a copy */
+        char buf[64] = "";
+        char *str = len < (int) sizeof(buf) ? buf : (char *) malloc(len + 1);
+        if (!str) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        memcpy(str, token, len);
+        str[len] = '\0';
+
+        char *end = NULL;
+        if (arg)
+                *arg = strtod(str, &end);
+        else
+                *iarg = strtoll(str, &end, 10);
+        src->ptr = end == str ? save : token + (end - str);
+
+        if (str != buf)
+                free(str);
+}
+
+/* make room for n more bytes, keeping ptr and last valid */
+void code_reserve(struct code *code, size_t n)
+{
+        size_t size = code->ptr - code->code;
+        if (code->code && size + n <= code->capacity)
+                return;
+
+        size_t capacity = code->capacity ? code->capacity : n;
+        while (capacity < size + n)
+                capacity *= 2;
+
+        size_t last = code->last ? code->last - code->code : 0;
+        char *data = (char *) realloc(code->code, capacity);
+        if (!data) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        code->last = code->last ? data + last : NULL;
+        code->code = data;
+        code->ptr = data + size;
+        code->capacity = capacity;
+}
+
 static FILE *create_bin(void)
 {
         FILE *bin = fopen("program", "wb+");
@@ -180,18 +653,22 @@ static FILE *create_bin(void)
         return bin;
 }
 
-static void write_bin(FILE *bin, struct code *code)
+/* write the concatenation of codes and the line table to ./program */
+void write_bin(const struct code *codes, int ncodes,
+                const struct lines *lines)
 {
-        if (!bin) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
-        }
+        uint32_t code_size = 0;
+        for (int i = 0; i < ncodes; ++i)
+                code_size += codes[i].ptr - codes[i].code;
 
-        uint32_t code_size = code->ptr - code->code;
-
-        struct header header = {0x61796b, 1, code_size, 0};
+        struct header header = {0x61796b, 1, code_size,
+                lines ? (uint32_t) HEADER_DEBUG : 0};
 
+        FILE *bin = create_bin();
         fwrite(&header, 1, sizeof(struct header), bin);
-
-        fwrite(code, code_size, 1, bin); 
+        for (int i = 0; i < ncodes; ++i)
+                fwrite(codes[i].code, codes[i].ptr - codes[i].code, 1, bin);
+        if (lines)
+                lines_write(lines, bin);
+        fclose(bin);
 }
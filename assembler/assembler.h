@@ -1,14 +1,50 @@
 #ifndef ASSEMBLER_H
 #define ASSEMBLER_H
 
+#include <stdio.h>
 #include "common.h"
 
 struct code {
-        char code[codelen];
+        char *code;
+        size_t capacity;
         char *ptr;
+        char *last;     /* last emitted instruction, if it may be fused */
 };
 
-void run_assembler(const char *filename);
-int parse_cmd(const char *cmd);
+/* mapped source file, read front to back through ptr */
+struct source {
+        const char *data;
+        size_t size;
+        const char *ptr;
+        const char *end;
+        const char *line_ptr;   /* lines are counted up to here, */
+        int line;               /* which is on this line */
+};
+
+struct labels;
+struct lines;
+
+static inline int isspace_src(char c)
+{
+        return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+enum asm_flags {
+        ASM_FUSE = 1 << 0,      /* peephole superinstruction fusion */
+        ASM_DEBUG = 1 << 1,     /* write a line table after the code */
+};
+
+void run_assembler(const char *filename, int flags, int nthreads);
+void assemble_parallel(const struct source *src, const char *filename,
+                int flags, int nthreads);
+void translate_src(struct source *src, struct code *code,
+                struct labels *labels, struct lines *lines, int flags);
+int src_line(struct source *src, const char *at);
+void code_reserve(struct code *code, size_t n);
+void write_bin(const struct code *codes, int ncodes,
+                const struct lines *lines);
+int parse_cmd(const char *cmd, int len);
+const char *next_token(struct source *src, int *len);
+int fuse_cmd(int prev, int opcode);
 
 #endif
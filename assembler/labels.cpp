@@ -1,11 +1,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "labels.h"
-#include "assembler.h"
-#include "common.h"
 
-static void move_pos(int opcode, int *ip);
+static int parse_offset(const char *name, int len, int *val);
+static uint32_t label_hash(const char *name, int len);
+static struct label *label_slot(const struct labels *labels, const char *name,
+                int len, uint32_t hash);
+static void labels_grow(struct labels *labels);
+static int intern(struct labels *labels, const char *name, int len);
 
 void labels_ctor(struct labels *labels, int capacity)
 {
@@ -14,130 +18,234 @@ void labels_ctor(struct labels *labels, int capacity)
                 exit(1);
         }
 
-        labels->data = (struct label *) calloc(capacity, sizeof(struct label));
+        int pow2 = 16;
+        while (pow2 < capacity)
+                pow2 *= 2;
 
+        labels->data = (struct label *) malloc(pow2 * sizeof(struct label));
         if (!labels->data) {
                 fprintf(stderr, "error: couldn't allocate memory\n");
                 exit(1);
         }
-
-        labels->capacity = capacity;
+        for (int i = 0; i < pow2; ++i)
+                labels->data[i].name = -1;
+
+        labels->size = 0;
+        labels->capacity = pow2;
+        labels->names = NULL;
+        labels->names_size = 0;
+        labels->names_capacity = 0;
+        labels->refs = NULL;
+        labels->nrefs = 0;
+        labels->refs_capacity = 0;
+        labels->deferred = 0;
 }
 
 void labels_dtor(struct labels *labels)
 {
         free(labels->data);
         labels->data = NULL;
+        free(labels->names);
+        labels->names = NULL;
+        free(labels->refs);
+        labels->refs = NULL;
 }
 
-int islabel(char *str)
+/* name is a label definition if its only ':' is the last character */
+int islabel(const char *name, int len)
 {
-        for (int i = 0; str[i] != '\0'; ++i) {
-                if (str[i] != ':')
-                        continue;
-                if (str[i+1] == '\0')
-                        return 1;
-                break;
-        }
-        return 0;
+        const char *colon = (const char *) memchr(name, ':', len);
+        return colon && colon == name + len - 1;
 }
 
-int label_replace(char *ptr, struct labels *labels, char *arg)
+/* code offset of the label, -1 if it is not defined */
+int label_find(const struct labels *labels, const char *name, int len)
 {
-        int val = -1;
-        for (int i = 0; i < labels->size; ++i)
-                if (strncmp(arg, labels->data[i].name, strlen(arg) - 1) == 0)
-                        val = labels->data[i].val;
-        if (val < 0)
-                return val;
-
-        memcpy(ptr, &val, sizeof(int)); 
-        return val;
+        const struct label *label = label_slot(labels, name, len,
+                        label_hash(name, len));
+        return label->name >= 0 ? label->val : -1;
 }
 
-void labels_find(FILE *src, struct labels *labels)
+/*
+ * Remember a jump target at code offset pos that is not defined yet. The
+ * name is not copied, it must stay valid until labels_resolve().
+ */
+void label_ref(struct labels *labels, int pos, const char *name, int len)
 {
-        int ip = 0;
-        char cmd[label_len];
+        if (labels->nrefs == labels->refs_capacity) {
+                labels->refs_capacity = labels->refs_capacity ?
+                        labels->refs_capacity * 2 : 256;
+                labels->refs = (struct label_ref *) realloc(labels->refs,
+                                labels->refs_capacity *
+                                sizeof(struct label_ref));
+                if (!labels->refs) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+        }
 
-        while (fscanf(src, "%s", cmd) == 1) {
-                int opcode = parse_cmd(cmd); 
+        struct label_ref *ref = &labels->refs[labels->nrefs++];
+        ref->pos = pos;
+        ref->name = name;
+        ref->len = len;
+}
 
-                if (opcode >= 0) {
-                        move_pos(opcode, &ip);
-                        continue;
+/*
+ * Backpatch every reference remembered in labels into code once all
+ * labels are known, looking them up in defs (usually labels itself). A
+ * target that names no label must be a literal byte offset.
+ */
+void labels_resolve(struct labels *labels, const struct labels *defs,
+                char *code)
+{
+        for (int i = 0; i < labels->nrefs; ++i) {
+                struct label_ref *ref = &labels->refs[i];
+                int val = label_find(defs, ref->name, ref->len);
+                if (val < 0 && !parse_offset(ref->name, ref->len, &val)) {
+                        fprintf(stderr, "error: undefined label \"%.*s\"\n",
+                                        ref->len, ref->name);
+                        exit(1);
                 }
-                if (islabel(cmd))
-                        label_insert(labels, cmd, ip);
+                memcpy(code + ref->pos, &val, sizeof(int));
         }
-        fseek(src, 0L, SEEK_SET);
+        labels->nrefs = 0;
 }
 
-static void move_pos(int opcode, int *ip)
+/* define the labels of a chunk that starts at code offset base */
+void labels_merge(struct labels *labels, const struct labels *chunk,
+                int base)
 {
-        switch (opcode) {
-                case CMD_HLT:
-                case CMD_ADD:
-                case CMD_SUB:
-                case CMD_MUL:
-                case CMD_DIV:
-                case CMD_OUT:
-                case CMD_IN:
-                case CMD_SQRT:
-                case CMD_SIN:
-                case CMD_COS:
-                        *ip += sizeof(char);
-                        break;
-                case CMD_PUSH:
-                        *ip += sizeof(char) + sizeof(double);
-                        break;
-                case CMD_JMP:
-                case CMD_JA:
-                case CMD_JAE:
-                case CMD_JB:
-                case CMD_JBE:
-                case CMD_JE:
-                case CMD_JNE:
-                        *ip += sizeof(char) + sizeof(int);
-                        break;
+        for (int i = 0; i < chunk->capacity; ++i) {
+                const struct label *label = &chunk->data[i];
+                if (label->name < 0)
+                        continue;
+                label_insert(labels, chunk->names + label->name, label->len,
+                                label->val + base);
         }
 }
 
-void label_insert(struct labels *labels, char *name, int val)
+/* [+-]digits spanning the whole of name */
+static int parse_offset(const char *name, int len, int *val)
 {
-        if (!labels) {
+        int i = 0;
+        int sign = 1;
+        if (i < len && (name[i] == '+' || name[i] == '-'))
+                sign = name[i++] == '-' ? -1 : 1;
+        if (i == len)
+                return 0;
+
+        long num = 0;
+        for (; i < len; ++i) {
+                if (name[i] < '0' || name[i] > '9' || num > INT_MAX)
+                        return 0;
+                num = num * 10 + name[i] - '0';
+        }
+        if (num > INT_MAX)
+                return 0;
+
+        *val = sign * num;
+        return 1;
+}
+
+/* name is len chars long and need not be zero-terminated */
+void label_insert(struct labels *labels, const char *name, int len, int val)
+{
+        if (!labels || !name) {
                 fprintf(stderr, "error: null pointer\n");
                 exit(1);
         }
 
-        for (int i = 0; i < labels->size; ++i)
-                if (strncmp(name, labels->data[i].name, strlen(name) - 1) == 0) {
-                        fprintf(stderr, "error: label \"%s\" already declared\n",
-                                        name);
-                        exit(1);
-                }
+        if (2 * (labels->size + 1) > labels->capacity)
+                labels_grow(labels);
 
-        strncpy(labels->data[labels->size].name, name, strlen(name) - 1);
-        labels->data[labels->size].val = val;
+        uint32_t hash = label_hash(name, len);
+        struct label *label = label_slot(labels, name, len, hash);
+        if (label->name >= 0) {
+                fprintf(stderr, "error: label \"%.*s\" already declared\n",
+                                len, name);
+                exit(1);
+        }
 
+        label->hash = hash;
+        label->name = intern(labels, name, len);
+        label->len = len;
+        label->val = val;
         ++labels->size;
 }
 
-#ifdef DEBUG
-void labels_dump(struct labels *labels)
+/* FNV-1a */
+static uint32_t label_hash(const char *name, int len)
 {
-        if (!labels) {
-                fprintf(stderr, "error: null pointer\n");
+        uint32_t hash = 2166136261u;
+        for (int i = 0; i < len; ++i) {
+                hash ^= (unsigned char) name[i];
+                hash *= 16777619u;
+        }
+        return hash;
+}
+
+/* the slot holding name, or the free slot where it would go */
+static struct label *label_slot(const struct labels *labels, const char *name,
+                int len, uint32_t hash)
+{
+        int mask = labels->capacity - 1;
+        for (int i = hash & mask;; i = (i + 1) & mask) {
+                struct label *label = &labels->data[i];
+                if (label->name < 0)
+                        return label;
+                if (label->hash == hash && label->len == len &&
+                                memcmp(labels->names + label->name, name,
+                                        len) == 0)
+                        return label;
+        }
+}
+
+static void labels_grow(struct labels *labels)
+{
+        struct label *old = labels->data;
+        int old_capacity = labels->capacity;
+
+        labels->capacity *= 2;
+        labels->data = (struct label *) malloc(labels->capacity *
+                        sizeof(struct label));
+        if (!labels->data) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
                 exit(1);
         }
+        for (int i = 0; i < labels->capacity; ++i)
+                labels->data[i].name = -1;
 
-        printf("labels capacity: %d\n", labels->capacity);
-        printf("labels size: %d\n", labels->size);
+        int mask = labels->capacity - 1;
+        for (int i = 0; i < old_capacity; ++i) {
+                if (old[i].name < 0)
+                        continue;
+                int j = old[i].hash & mask;
+                while (labels->data[j].name >= 0)
+                        j = (j + 1) & mask;
+                labels->data[j] = old[i];
+        }
+        free(old);
+}
 
-        for (int i = 0; i < labels->size; ++i) {
-                printf("name: %s\n", labels->data[i].name);
-                printf("val: %d", labels->data[i].val);
-                printf("\n");
+/* copy name into the pool, returns its offset */
+static int intern(struct labels *labels, const char *name, int len)
+{
+        if (labels->names_size + len + 1 > labels->names_capacity) {
+                size_t capacity = labels->names_capacity ?
+                        labels->names_capacity : 4096;
+                while (capacity < labels->names_size + len + 1)
+                        capacity *= 2;
+                labels->names = (char *) realloc(labels->names, capacity);
+                if (!labels->names) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+                labels->names_capacity = capacity;
         }
+
+        int offset = labels->names_size;
+        memcpy(labels->names + offset, name, len);
+        labels->names[offset + len] = '\0';
+        labels->names_size += len + 1;
+        return offset;
 }
-#endif
@@ -1,28 +1,52 @@
 #ifndef LABELS_H
 #define LABELS_H
 
-const int label_len = 15;
+#include <stdio.h>
+#include <stdint.h>
 
+/*
+ * Open-addressing hash table from label name to code offset. Names are
+ * interned into one growing pool and referred to by offset, so there is
+ * no limit on their length or count. Jump targets that are not defined
+ * yet are kept as references and backpatched once the source is read.
+ */
 struct label {
+        uint32_t hash;
+        int name;               /* offset into labels->names, -1 if free */
+        int len;
         int val;
-        char name[label_len];
+};
+
+struct label_ref {
+        int pos;                /* code offset of the int target */
+        const char *name;       /* points into the source */
+        int len;
 };
 
 struct labels {
         struct label *data;
         int size;
-        int capacity;
+        int capacity;           /* power of two */
+        char *names;
+        size_t names_size;
+        size_t names_capacity;
+        struct label_ref *refs;
+        int nrefs;
+        int refs_capacity;
+        int deferred;           /* offsets are chunk-relative, every jump
+                                   target is left as a reference */
 };
 
 void labels_ctor(struct labels *labels, int capacity);
 void labels_dtor(struct labels *labels);
 
-int islabel(char *str);
-void label_insert(struct labels *labels, char *name, int val);
-int label_replace(char *ptr, struct labels *labels, char *arg);
-void labels_find(FILE *src, struct labels *labels);
-#ifdef DEBUG
-void labels_dump(struct labels *labels);
-#endif
+int islabel(const char *name, int len);
+void label_insert(struct labels *labels, const char *name, int len, int val);
+int label_find(const struct labels *labels, const char *name, int len);
+void label_ref(struct labels *labels, int pos, const char *name, int len);
+void labels_resolve(struct labels *labels, const struct labels *defs,
+                char *code);
+void labels_merge(struct labels *labels, const struct labels *chunk,
+                int base);
 
 #endif
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "lines.h"
+
+static uint32_t add_name(struct lines *lines, const char *name, int len);
+static void reserve_names(struct lines *lines, uint32_t n);
+
+/* file is the first name of the table, chunks of a parallel run pass NULL */
+void lines_ctor(struct lines *lines, const char *file)
+{
+        if (!lines) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        lines->data = NULL;
+        lines->size = 0;
+        lines->capacity = 0;
+        lines->names = NULL;
+        lines->names_size = 0;
+        lines->names_capacity = 0;
+        lines->label = debug_nolabel;
+        if (file)
+                add_name(lines, file, strlen(file));
+}
+
+void lines_dtor(struct lines *lines)
+{
+        free(lines->data);
+        lines->data = NULL;
+        free(lines->names);
+        lines->names = NULL;
+}
+
+/* an instruction at offset starts on line, only the first one counts */
+void lines_add(struct lines *lines, uint32_t offset, uint32_t line)
+{
+        if (lines->size && lines->data[lines->size - 1].line == line)
+                return;
+
+        if (lines->size == lines->capacity) {
+                lines->capacity = lines->capacity ? lines->capacity * 2 : 256;
+                lines->data = (struct debug_line *) realloc(lines->data,
+                                lines->capacity * sizeof(struct debug_line));
+                if (!lines->data) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+        }
+
+        struct debug_line *entry = &lines->data[lines->size++];
+        entry->offset = offset;
+        entry->line = line;
+        entry->label = lines->label;
+}
+
+/* lines added from now on are below the label name (without the ':') */
+void lines_label(struct lines *lines, const char *name, int len)
+{
+        lines->label = add_name(lines, name, len);
+}
+
+/*
+ * Append the table of a chunk whose code starts at base and whose source
+ * starts base_line lines into the file. Lines of the chunk above its
+ * first label belong to the label the previous chunks ended with.
+ */
+void lines_merge(struct lines *lines, const struct lines *chunk,
+                uint32_t base, uint32_t base_line)
+{
+        uint32_t names_base = lines->names_size;
+        reserve_names(lines, chunk->names_size);
+        memcpy(lines->names + names_base, chunk->names, chunk->names_size);
+        lines->names_size += chunk->names_size;
+
+        uint32_t label = lines->label;
+        for (int i = 0; i < chunk->size; ++i) {
+                struct debug_line entry = chunk->data[i];
+                if (entry.label != debug_nolabel)
+                        label = names_base + entry.label;
+                lines->label = label;
+                lines_add(lines, base + entry.offset, base_line + entry.line);
+        }
+        if (chunk->label != debug_nolabel)
+                lines->label = names_base + chunk->label;
+}
+
+void lines_write(const struct lines *lines, FILE *bin)
+{
+        struct debug_header header = {(uint32_t) lines->size,
+                lines->names_size};
+        fwrite(&header, sizeof(header), 1, bin);
+        fwrite(lines->data, sizeof(struct debug_line), lines->size, bin);
+        fwrite(lines->names, 1, lines->names_size, bin);
+}
+
+/* offset of a NUL-terminated copy of name in lines->names */
+static uint32_t add_name(struct lines *lines, const char *name, int len)
+{
+        reserve_names(lines, len + 1);
+        uint32_t offset = lines->names_size;
+        memcpy(lines->names + offset, name, len);
+        lines->names[offset + len] = '\0';
+        lines->names_size += len + 1;
+        return offset;
+}
+
+/* make room for n more bytes of names */
+static void reserve_names(struct lines *lines, uint32_t n)
+{
+        if (lines->names_size + n <= lines->names_capacity)
+                return;
+
+        uint32_t capacity = lines->names_capacity ?
+                lines->names_capacity : 256;
+        while (capacity < lines->names_size + n)
+                capacity *= 2;
+        lines->names = (char *) realloc(lines->names, capacity);
+        if (!lines->names) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        lines->names_capacity = capacity;
+}
@@ -0,0 +1,31 @@
+#ifndef LINES_H
+#define LINES_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * Line table written after the code with -g, see struct debug_header.
+ * Every source line that starts an instruction gets one entry with the
+ * code offset of that instruction and the label defined last above it.
+ */
+struct lines {
+        struct debug_line *data;
+        int size;
+        int capacity;
+        char *names;
+        uint32_t names_size;
+        uint32_t names_capacity;
+        uint32_t label;         /* last label defined, or debug_nolabel */
+};
+
+void lines_ctor(struct lines *lines, const char *file);
+void lines_dtor(struct lines *lines);
+void lines_add(struct lines *lines, uint32_t offset, uint32_t line);
+void lines_label(struct lines *lines, const char *name, int len);
+void lines_merge(struct lines *lines, const struct lines *chunk,
+                uint32_t base, uint32_t base_line);
+void lines_write(const struct lines *lines, FILE *bin);
+
+#endif
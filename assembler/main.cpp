@@ -1,14 +1,37 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 #include "assembler.h"
 
 int main(int argc, char *argv[])
 {
-        if (argc != 2) {
+        int flags = 0;
+        int nthreads = 1;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "Ogt:")) != -1) {
+                switch (opt) {
+                        case 'O':
+                                flags |= ASM_FUSE;
+                                break;
+                        case 'g':
+                                flags |= ASM_DEBUG;
+                                break;
+                        case 't':
+                                nthreads = strtol(optarg, NULL, 10);
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-O] [-g] [-t threads] "
+                                                "source\n", argv[0]);
+                                exit(1);
+                }
+        }
+
+        if (optind != argc - 1) {
                 fprintf(stderr, "error: source file not specified\n");
                 exit(1);
         }
 
-        run_assembler(argv[1]);
+        run_assembler(argv[optind], flags, nthreads);
         return 0;
 }
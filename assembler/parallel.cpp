@@ -0,0 +1,228 @@
+/*
+ * parallel - assemble one big source on several threads
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "common.h"
+#include "assembler.h"
+#include "labels.h"
+#include "lines.h"
+
+/*
+ * The source is cut into one chunk per thread at line starts where the
+ * serial pass is known to begin a new statement: the token before the
+ * cut must not be an instruction that takes an operand, and with fusion
+ * the line must start with a label so that no superinstruction spans two
+ * chunks. Every chunk is translated into its own code with its own label
+ * table and all of its jump targets deferred. The chunk offsets are the
+ * prefix sums of the code sizes; the chunk labels are merged into one
+ * table at those offsets and every chunk then backpatches its targets
+ * from it. Writing the chunks one after another gives the same bytes as
+ * the serial pass. Line tables are merged the same way, with the line
+ * numbers of a chunk offset by the lines of the chunks before it.
+ */
+struct chunk {
+        struct source src;
+        struct code code;
+        struct labels labels;
+        const struct labels *defs;      /* merged labels of all chunks */
+        struct lines lines;
+        int nlines;                     /* newlines in src */
+        int flags;
+};
+
+/* smaller chunks are not worth a thread */
+static const size_t min_chunk = 1 << 16;
+
+static int split_src(const struct source *src, struct chunk *chunks,
+                int nchunks, int flags);
+static const char *find_cut(const struct source *src, const char *from,
+                int flags);
+static int is_cut(const struct source *src, const char *line, int flags);
+static void run_chunks(struct chunk *chunks, int nchunks,
+                void *(*fn)(void *));
+static void *translate_chunk(void *arg);
+static void *resolve_chunk(void *arg);
+
+void assemble_parallel(const struct source *src, const char *filename,
+                int flags, int nthreads)
+{
+        int nchunks = nthreads;
+        if (src->size / min_chunk < (size_t) nchunks)
+                nchunks = src->size / min_chunk;
+        if (nchunks < 1)
+                nchunks = 1;
+
+        struct chunk *chunks = (struct chunk *) calloc(nchunks,
+                        sizeof(struct chunk));
+        struct code *codes = (struct code *) calloc(nchunks,
+                        sizeof(struct code));
+        if (!chunks || !codes) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        nchunks = split_src(src, chunks, nchunks, flags);
+        run_chunks(chunks, nchunks, translate_chunk);
+
+        int nlabels = 0;
+        for (int i = 0; i < nchunks; ++i)
+                nlabels += chunks[i].labels.size;
+
+        struct labels labels = {};
+        labels_ctor(&labels, 2 * nlabels + 2);
+        int base = 0;
+        for (int i = 0; i < nchunks; ++i) {
+                labels_merge(&labels, &chunks[i].labels, base);
+                base += chunks[i].code.ptr - chunks[i].code.code;
+                chunks[i].defs = &labels;
+        }
+
+        run_chunks(chunks, nchunks, resolve_chunk);
+
+        struct lines lines = {};
+        if (flags & ASM_DEBUG) {
+                lines_ctor(&lines, filename);
+                int base_line = 0;
+                base = 0;
+                for (int i = 0; i < nchunks; ++i) {
+                        lines_merge(&lines, &chunks[i].lines, base,
+                                        base_line);
+                        base += chunks[i].code.ptr - chunks[i].code.code;
+                        base_line += chunks[i].nlines;
+                }
+        }
+
+        for (int i = 0; i < nchunks; ++i)
+                codes[i] = chunks[i].code;
+        write_bin(codes, nchunks, (flags & ASM_DEBUG) ? &lines : NULL);
+
+        for (int i = 0; i < nchunks; ++i) {
+                labels_dtor(&chunks[i].labels);
+                lines_dtor(&chunks[i].lines);
+                free(chunks[i].code.code);
+        }
+        lines_dtor(&lines);
+        labels_dtor(&labels);
+        free(codes);
+        free(chunks);
+}
+
+/* fill chunks with consecutive pieces of src, returns how many there are */
+static int split_src(const struct source *src, struct chunk *chunks,
+                int nchunks, int flags)
+{
+        const char *begin = src->data;
+        int n = 0;
+
+        for (int i = 1; i < nchunks; ++i) {
+                const char *from = src->data + src->size * i / nchunks;
+                const char *cut = find_cut(src, from > begin ? from : begin,
+                                flags);
+                if (cut == src->end)
+                        break;
+
+                chunks[n].src.ptr = begin;
+                chunks[n].src.end = cut;
+                chunks[n].flags = flags;
+                ++n;
+                begin = cut;
+        }
+
+        chunks[n].src.ptr = begin;
+        chunks[n].src.end = src->end;
+        chunks[n].flags = flags;
+        return n + 1;
+}
+
+/* the first line start after from where a chunk may begin, or src->end */
+static const char *find_cut(const struct source *src, const char *from,
+                int flags)
+{
+        const char *line = from;
+        while (line < src->end) {
+                line = (const char *) memchr(line, '\n', src->end - line);
+                if (!line)
+                        return src->end;
+                ++line;
+                if (line < src->end && is_cut(src, line, flags))
+                        return line;
+        }
+        return src->end;
+}
+
+static int is_cut(const struct source *src, const char *line, int flags)
+{
+        struct source next = {};
+        next.ptr = line;
+        next.end = src->end;
+
+        int len = 0;
+        const char *token = next_token(&next, &len);
+        if (!token)
+                return 0;
+        if ((flags & ASM_FUSE) && !islabel(token, len))
+                return 0;
+
+        /* the token before line, if it is an opcode its operand follows */
+        const char *end = line;
+        while (end > src->data && isspace_src(end[-1]))
+                --end;
+        const char *prev = end;
+        while (prev > src->data && !isspace_src(prev[-1]))
+                --prev;
+
+        int opcode = parse_cmd(prev, end - prev);
+        return opcode < 0 || (!cmd_has_arg(opcode) && !cmd_is_jmp(opcode) &&
+                        !cmd_has_reg(opcode));
+}
+
+static void run_chunks(struct chunk *chunks, int nchunks,
+                void *(*fn)(void *))
+{
+        pthread_t *threads = (pthread_t *) calloc(nchunks,
+                        sizeof(pthread_t));
+        if (!threads) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        for (int i = 0; i < nchunks; ++i) {
+                if (pthread_create(&threads[i], NULL, fn, &chunks[i]) != 0) {
+                        fprintf(stderr, "error: couldn't create thread\n");
+                        exit(1);
+                }
+        }
+        for (int i = 0; i < nchunks; ++i)
+                pthread_join(threads[i], NULL);
+        free(threads);
+}
+
+static void *translate_chunk(void *arg)
+{
+        struct chunk *chunk = (struct chunk *) arg;
+
+        code_reserve(&chunk->code, 4096);
+        labels_ctor(&chunk->labels, 16);
+        chunk->labels.deferred = 1;
+        if (chunk->flags & ASM_DEBUG)
+                lines_ctor(&chunk->lines, NULL);
+
+        translate_src(&chunk->src, &chunk->code, &chunk->labels,
+                        (chunk->flags & ASM_DEBUG) ? &chunk->lines : NULL,
+                        chunk->flags);
+        if (chunk->flags & ASM_DEBUG)
+                chunk->nlines = src_line(&chunk->src, chunk->src.end) - 1;
+        return NULL;
+}
+
+static void *resolve_chunk(void *arg)
+{
+        struct chunk *chunk = (struct chunk *) arg;
+
+        labels_resolve(&chunk->labels, chunk->defs, chunk->code.code);
+        return NULL;
+}
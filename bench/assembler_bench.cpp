@@ -0,0 +1,76 @@
+/*
+ * assembler_bench - assembly throughput in MB of source per second
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "assembler.h"
+#include "bench.h"
+
+/* the binary is written to ./program like the command line tool does */
+int main(int argc, char *argv[])
+{
+        struct bench_baseline baseline = {};
+        struct bench_baseline results = {};
+        const char *save = NULL;
+        int repeats = 3;
+        int nthreads = 1;
+        int flags = 0;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "Ot:r:b:s:")) != -1) {
+                switch (opt) {
+                        case 'O':
+                                flags |= ASM_FUSE;
+                                break;
+                        case 't':
+                                nthreads = strtol(optarg, NULL, 10);
+                                break;
+                        case 'r':
+                                repeats = strtol(optarg, NULL, 10);
+                                break;
+                        case 'b':
+                                bench_load(&baseline, optarg);
+                                break;
+                        case 's':
+                                save = optarg;
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-O] [-t threads] [-r repeats] "
+                                                "[-b baseline] [-s baseline] "
+                                                "source...\n", argv[0]);
+                                exit(1);
+                }
+        }
+
+        for (int i = optind; i < argc; ++i) {
+                struct stat st = {};
+                if (stat(argv[i], &st) < 0) {
+                        fprintf(stderr, "error: couldn't open file\n");
+                        exit(1);
+                }
+
+                double best = 0;
+                for (int r = 0; r < repeats; ++r) {
+                        double start = bench_now();
+                        run_assembler(argv[i], flags, nthreads);
+                        double time = bench_now() - start;
+                        if (r == 0 || time < best)
+                                best = time;
+                }
+
+                char name[bench_name_len] = "";
+                bench_name(name, argv[i]);
+                double rate = st.st_size / best * 1e-6;
+                bench_report(&baseline, name, rate, "MB/s");
+                bench_add(&results, name, rate);
+        }
+
+        if (save)
+                bench_save(&results, save);
+        free(baseline.data);
+        free(results.data);
+        return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Shared by the benchmark drivers: a baseline file has one
+ * "<name> <value>" line per benchmark, bigger values are better.
+ */
+const int bench_name_len = 64;
+
+struct bench_entry {
+        char name[bench_name_len];
+        double val;
+};
+
+struct bench_baseline {
+        struct bench_entry *data;
+        int size;
+        int capacity;
+};
+
+static inline double bench_now(void)
+{
+        struct timespec ts = {};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* "dir/count.bin" -> "count" */
+static inline void bench_name(char *name, const char *path)
+{
+        const char *base = strrchr(path, '/');
+        base = base ? base + 1 : path;
+        snprintf(name, bench_name_len, "%s", base);
+
+        char *dot = strrchr(name, '.');
+        if (dot && dot != name)
+                *dot = '\0';
+}
+
+static inline void bench_add(struct bench_baseline *bl, const char *name,
+                double val)
+{
+        if (bl->size == bl->capacity) {
+                bl->capacity = bl->capacity ? bl->capacity * 2 : 16;
+                bl->data = (struct bench_entry *) realloc(bl->data,
+                                bl->capacity * sizeof(struct bench_entry));
+                if (!bl->data) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+        }
+        snprintf(bl->data[bl->size].name, bench_name_len, "%s", name);
+        bl->data[bl->size].val = val;
+        ++bl->size;
+}
+
+/* a missing baseline file is an empty baseline */
+static inline void bench_load(struct bench_baseline *bl, const char *filename)
+{
+        FILE *file = fopen(filename, "r");
+        if (!file)
+                return;
+
+        char name[bench_name_len] = "";
+        double val = 0;
+        while (fscanf(file, "%63s %lg", name, &val) == 2)
+                bench_add(bl, name, val);
+        fclose(file);
+}
+
+static inline void bench_save(const struct bench_baseline *bl,
+                const char *filename)
+{
+        FILE *file = fopen(filename, "w");
+        if (!file) {
+                fprintf(stderr, "error: couldn't open file\n");
+                exit(1);
+        }
+
+        for (int i = 0; i < bl->size; ++i)
+                fprintf(file, "%s %.1f\n", bl->data[i].name, bl->data[i].val);
+        fclose(file);
+}
+
+/* print one result, compared against the baseline if it has the name */
+static inline void bench_report(const struct bench_baseline *bl,
+                const char *name, double val, const char *unit)
+{
+        printf("%-12s %10.1f %s", name, val, unit);
+        for (int i = 0; i < bl->size; ++i) {
+                if (strcmp(bl->data[i].name, name) != 0)
+                        continue;
+                printf("   baseline %10.1f   %5.2fx", bl->data[i].val,
+                                val / bl->data[i].val);
+                break;
+        }
+        printf("\n");
+}
+
+#endif
@@ -0,0 +1,71 @@
+push 0
+loop:
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+push 1
+add
+in
+push 0
+jne loop
+out
+hlt
@@ -0,0 +1,519 @@
+push 0
+loop:
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+push 5
+push 6
+push 7
+push 1
+push 2
+push 3
+push 4
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+sub
+add
+in
+push 0
+jne loop
+out
+hlt
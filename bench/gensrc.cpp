@@ -0,0 +1,81 @@
+/*
+ * gensrc - write a large random assembler source to stdout
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Instructions are drawn with a fixed mix (a third pushes, a fifth
+ * jumps if there are labels) from a seeded xorshift generator, so the
+ * same options always give the same file. Label names have the same
+ * length and a trailing letter so that no name is a prefix of another.
+ */
+static uint32_t next_rand(uint32_t *state);
+
+static const char *const simple[] = {"add", "sub", "mul", "div", "sqrt",
+        "sin", "cos", "in", "out"};
+static const char *const jumps[] = {"jmp", "ja", "jae", "jb", "jbe", "je",
+        "jne"};
+
+int main(int argc, char *argv[])
+{
+        long nlines = 1000000;
+        long nlabels = 8;
+        uint32_t state = 1;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "n:l:s:")) != -1) {
+                switch (opt) {
+                        case 'n':
+                                nlines = strtol(optarg, NULL, 10);
+                                break;
+                        case 'l':
+                                nlabels = strtol(optarg, NULL, 10);
+                                break;
+                        case 's':
+                                state = strtoul(optarg, NULL, 10) | 1;
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-n lines] "
+                                                "[-l labels] [-s seed]\n",
+                                                argv[0]);
+                                exit(1);
+                }
+        }
+
+        long label = 0;
+        int width = 1;
+        for (long n = nlabels - 1; n >= 10; n /= 10)
+                ++width;
+
+        for (long i = 0; i < nlines; ++i) {
+                if (label < nlabels && i * nlabels >= label * nlines) {
+                        printf("l%0*ldx:\n", width, label++);
+                        continue;
+                }
+
+                uint32_t r = next_rand(&state) % 100;
+                if (r < 33)
+                        printf("push %g\n", (next_rand(&state) % 200000) /
+                                        100.0 - 1000);
+                else if (r < 80 || nlabels == 0)
+                        printf("%s\n", simple[next_rand(&state) % 9]);
+                else
+                        printf("%s l%0*ldx\n", jumps[next_rand(&state) % 7],
+                                        width, (long) (next_rand(&state) %
+                                                nlabels));
+        }
+        printf("hlt\n");
+        return 0;
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+        *state ^= *state << 13;
+        *state ^= *state >> 17;
+        *state ^= *state << 5;
+        return *state;
+}
@@ -0,0 +1,73 @@
+ipush 0
+loop:
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+ipush 1
+iadd
+in
+ftoi
+ipush 0
+ijne loop
+itof
+out
+hlt
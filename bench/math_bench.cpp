@@ -0,0 +1,220 @@
+/*
+ * math_bench - accuracy and throughput of fastmath.h against libm
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "fastmath.h"
+#include "bench.h"
+
+/*
+ * Accuracy is the largest error of the fast functions in ulps of the
+ * libm result over uniform random arguments in a few ranges. Throughput
+ * evaluates a block of arguments in [-2pi, 2pi] per call, as libm, as the
+ * scalar fast functions the interpreter calls, and as the branch-free
+ * kernel over the whole block, which is what batch mode runs per
+ * instruction and what the compiler vectorizes. Built with the flags of
+ * batch.cpp, so libm sqrt is the inlined sqrtsd without errno too.
+ */
+const int math_block = 4096;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MATH_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define MATH_TARGETS
+#endif
+
+enum math_fn {
+        FN_SQRT,
+        FN_SIN,
+        FN_COS,
+        FN_SINCOS,
+        FN_COUNT,
+};
+
+enum math_impl {
+        IMPL_LIBM,
+        IMPL_FAST,
+        IMPL_BATCHED,
+        IMPL_COUNT,
+};
+
+static const char *const fn_names[] = {"sqrt", "sin", "cos", "sincos"};
+static const char *const impl_names[] = {"libm", "fast", "batched"};
+
+static double ulp_error(double got, double want);
+static void accuracy(long samples);
+static double throughput(int fn, int impl, const double *x, double *y,
+                double *z, long calls);
+static void eval(int fn, int impl, const double *x, double *y, double *z);
+MATH_TARGETS
+static void eval_batched(int fn, const double *x, double *y, double *z);
+
+int main(int argc, char *argv[])
+{
+        struct bench_baseline baseline = {};
+        struct bench_baseline results = {};
+        const char *save = NULL;
+        long samples = 10000000;
+        long calls = 100000000;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "a:n:b:s:")) != -1) {
+                switch (opt) {
+                        case 'a':
+                                samples = strtol(optarg, NULL, 10);
+                                break;
+                        case 'n':
+                                calls = strtol(optarg, NULL, 10);
+                                break;
+                        case 'b':
+                                bench_load(&baseline, optarg);
+                                break;
+                        case 's':
+                                save = optarg;
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-a samples] "
+                                                "[-n calls] [-b baseline] "
+                                                "[-s baseline]\n", argv[0]);
+                                exit(1);
+                }
+        }
+
+        accuracy(samples);
+
+        double *x = (double *) aligned_alloc(64, math_block * sizeof(double));
+        double *y = (double *) aligned_alloc(64, math_block * sizeof(double));
+        double *z = (double *) aligned_alloc(64, math_block * sizeof(double));
+        if (!x || !y || !z) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        srand48(2);
+        for (int i = 0; i < math_block; ++i)
+                x[i] = (drand48() * 2 - 1) * 2 * M_PI;
+
+        for (int fn = 0; fn < FN_COUNT; ++fn) {
+                for (int impl = 0; impl < IMPL_COUNT; ++impl) {
+                        char name[bench_name_len] = "";
+                        snprintf(name, bench_name_len, "%s_%s",
+                                        fn_names[fn], impl_names[impl]);
+                        double rate = throughput(fn, impl, x, y, z, calls);
+                        bench_report(&baseline, name, rate, "Mcalls/s");
+                        bench_add(&results, name, rate);
+                }
+        }
+
+        if (save)
+                bench_save(&results, save);
+        free(x);
+        free(y);
+        free(z);
+        free(baseline.data);
+        free(results.data);
+        return 0;
+}
+
+/* |got - want| in units of the spacing of doubles at want */
+static double ulp_error(double got, double want)
+{
+        if (got == want || (isnan(got) && isnan(want)))
+                return 0;
+        double ulp = nextafter(fabs(want), INFINITY) - fabs(want);
+        return fabsl((long double) got - want) / ulp;
+}
+
+static void accuracy(long samples)
+{
+        const double ranges[] = {M_PI / 4, M_PI, 100, 1e4, fast_trig_limit};
+        const int nranges = sizeof(ranges) / sizeof(ranges[0]);
+
+        for (int i = 0; i < nranges; ++i) {
+                double max_sin = 0, max_cos = 0, max_sqrt = 0;
+                srand48(1);
+                for (long k = 0; k < samples; ++k) {
+                        double x = (drand48() * 2 - 1) * ranges[i];
+                        double s = 0, c = 0;
+                        fast_sincos(x, &s, &c);
+                        max_sin = fmax(max_sin, ulp_error(s, sin(x)));
+                        max_cos = fmax(max_cos, ulp_error(c, cos(x)));
+                        max_sin = fmax(max_sin, ulp_error(fast_sin(x),
+                                                sin(x)));
+                        max_cos = fmax(max_cos, ulp_error(fast_cos(x),
+                                                cos(x)));
+                        max_sqrt = fmax(max_sqrt, ulp_error(fast_sqrt(
+                                                        fabs(x)),
+                                                sqrt(fabs(x))));
+                }
+                printf("|x| <= %-11g max error: sin %.2f  cos %.2f  "
+                                "sqrt %.2f ulp\n", ranges[i], max_sin,
+                                max_cos, max_sqrt);
+        }
+}
+
+/* millions of function calls per second, sincos counting as one */
+static double throughput(int fn, int impl, const double *x, double *y,
+                double *z, long calls)
+{
+        long rounds = calls / math_block;
+        if (rounds < 1)
+                rounds = 1;
+
+        double start = bench_now();
+        double sink = 0;
+        for (long r = 0; r < rounds; ++r) {
+                eval(fn, impl, x, y, z);
+                sink += y[r % math_block];
+        }
+        double time = bench_now() - start;
+
+        if (sink == 12345)
+                printf("\n");
+        return rounds * math_block / time * 1e-6;
+}
+
+static void eval(int fn, int impl, const double *x, double *y, double *z)
+{
+        if (impl == IMPL_BATCHED) {
+                eval_batched(fn, x, y, z);
+                return;
+        }
+
+        int fast = impl == IMPL_FAST;
+        for (int i = 0; i < math_block; ++i) {
+                switch (fn) {
+                        case FN_SQRT:
+                                y[i] = math_sqrt(fabs(x[i]), fast);
+                                break;
+                        case FN_SIN:
+                                y[i] = math_sin(x[i], fast);
+                                break;
+                        case FN_COS:
+                                y[i] = math_cos(x[i], fast);
+                                break;
+                        case FN_SINCOS:
+                                math_sincos(x[i], fast, &y[i], &z[i]);
+                                break;
+                }
+        }
+}
+
+MATH_TARGETS
+static void eval_batched(int fn, const double *x, double *y, double *z)
+{
+        if (fn == FN_SQRT) {
+                for (int i = 0; i < math_block; ++i)
+                        y[i] = sqrt(fabs(x[i]));
+                return;
+        }
+
+        for (int i = 0; i < math_block; ++i) {
+                double s = 0, c = 0;
+                fast_sincos_kernel(x[i], &s, &c);
+                y[i] = fn == FN_COS ? c : s;
+                if (fn == FN_SINCOS)
+                        z[i] = c;
+        }
+}
@@ -0,0 +1,99 @@
+push 0
+loop:
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+push 2
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+div
+add
+push 0.5
+mul
+push 2
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+push 2
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+div
+add
+push 0.5
+mul
+div
+add
+push 0.5
+mul
+push 2
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+push 2
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+div
+add
+push 0.5
+mul
+push 2
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+push 2
+push 1.5
+push 2
+push 1.5
+div
+add
+push 0.5
+mul
+div
+add
+push 0.5
+mul
+div
+add
+push 0.5
+mul
+div
+add
+push 0.5
+mul
+add
+in
+push 0
+jne loop
+out
+hlt
@@ -0,0 +1,147 @@
+/*
+ * processor_bench - instructions per second on the benchmark workloads
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include "processor.h"
+#include "sample.h"
+#include "bench.h"
+
+/*
+ * Every workload loops until in returns 0; in is fed from memory with
+ * iterations ones and out is discarded, so only the engine is timed.
+ * The instruction count comes from one run with an instruction budget,
+ * the time is the best of several unbudgeted runs. -p times the runs
+ * under the SIGPROF sampler to measure its overhead, -f with fast math.
+ */
+struct bench_io {
+        long left;
+        double sink;
+};
+
+static double bench_in(void *ctx);
+static void bench_out(void *ctx, double val);
+
+int main(int argc, char *argv[])
+{
+        struct bench_baseline baseline = {};
+        struct bench_baseline results = {};
+        const char *save = NULL;
+        long iterations = 1000000;
+        int repeats = 5;
+        int flags = 0;
+        int sampled = 0;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "fgjpn:r:b:s:")) != -1) {
+                switch (opt) {
+                        case 'f':
+                                flags |= PROC_FAST_MATH;
+                                break;
+                        case 'g':
+                                flags |= PROC_REG;
+                                break;
+                        case 'j':
+                                flags |= PROC_JIT;
+                                break;
+                        case 'p':
+                                sampled = 1;
+                                break;
+                        case 'n':
+                                iterations = strtol(optarg, NULL, 10);
+                                break;
+                        case 'r':
+                                repeats = strtol(optarg, NULL, 10);
+                                break;
+                        case 'b':
+                                bench_load(&baseline, optarg);
+                                break;
+                        case 's':
+                                save = optarg;
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-f] [-g] [-j] [-p] [-n iterations] "
+                                                "[-r repeats] [-b baseline] "
+                                                "[-s baseline] binary...\n",
+                                                argv[0]);
+                                exit(1);
+                }
+        }
+
+        for (int i = optind; i < argc; ++i) {
+                struct program prog = {};
+                struct processor processor = {};
+                struct bench_io io = {};
+
+                int status = program_load(&prog, argv[i]);
+                if (status != PROC_OK) {
+                        fprintf(stderr, "error: %s: %s\n", argv[i],
+                                        proc_strerror(status));
+                        exit(1);
+                }
+
+                processor_ctor(&processor, &prog);
+                processor.io.in = bench_in;
+                processor.io.out = bench_out;
+                processor.io.in_ctx = &io;
+                processor.io.out_ctx = &io;
+
+                io.left = iterations;
+                processor_run(&processor, 0, LONG_MAX);
+                long insns = LONG_MAX - processor.budget;
+
+                struct sampler sampler = {};
+                if (sampled) {
+                        sampler_ctor(&sampler, &prog);
+                        processor.sampler = &sampler;
+                        sampler_start(&sampler);
+                }
+
+                double best = 0;
+                for (int r = 0; r < repeats; ++r) {
+                        processor_reset(&processor);
+                        io.left = iterations;
+                        double start = bench_now();
+                        processor_run(&processor, flags, -1);
+                        double time = bench_now() - start;
+                        if (r == 0 || time < best)
+                                best = time;
+                }
+
+                if (sampled) {
+                        sampler_stop(&sampler);
+                        sampler_dtor(&sampler);
+                        processor.sampler = NULL;
+                }
+
+                char name[bench_name_len] = "";
+                bench_name(name, argv[i]);
+                double rate = insns / best * 1e-6;
+                bench_report(&baseline, name, rate, "Minstr/s");
+                bench_add(&results, name, rate);
+
+                processor_dtor(&processor);
+                program_dtor(&prog);
+        }
+
+        if (save)
+                bench_save(&results, save);
+        free(baseline.data);
+        free(results.data);
+        return 0;
+}
+
+static double bench_in(void *ctx)
+{
+        struct bench_io *io = (struct bench_io *) ctx;
+        return io->left-- > 0 ? 1 : 0;
+}
+
+static void bench_out(void *ctx, double val)
+{
+        struct bench_io *io = (struct bench_io *) ctx;
+        io->sink += val;
+}
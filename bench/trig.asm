@@ -0,0 +1,167 @@
+push 0
+loop:
+push 0.7
+sin
+push 1
+mul
+add
+push 0.7
+cos
+push 1
+mul
+add
+push 1.4
+sin
+push 0.5
+mul
+add
+push 1.4
+cos
+push 0.25
+mul
+add
+push 2.1
+sin
+push 0.333333
+mul
+add
+push 2.1
+cos
+push 0.111111
+mul
+add
+push 2.8
+sin
+push 0.25
+mul
+add
+push 2.8
+cos
+push 0.0625
+mul
+add
+push 3.5
+sin
+push 0.2
+mul
+add
+push 3.5
+cos
+push 0.04
+mul
+add
+push 4.2
+sin
+push 0.166667
+mul
+add
+push 4.2
+cos
+push 0.0277778
+mul
+add
+push 4.9
+sin
+push 0.142857
+mul
+add
+push 4.9
+cos
+push 0.0204082
+mul
+add
+push 5.6
+sin
+push 0.125
+mul
+add
+push 5.6
+cos
+push 0.015625
+mul
+add
+push 6.3
+sin
+push 0.111111
+mul
+add
+push 6.3
+cos
+push 0.0123457
+mul
+add
+push 7
+sin
+push 0.1
+mul
+add
+push 7
+cos
+push 0.01
+mul
+add
+push 7.7
+sin
+push 0.0909091
+mul
+add
+push 7.7
+cos
+push 0.00826446
+mul
+add
+push 8.4
+sin
+push 0.0833333
+mul
+add
+push 8.4
+cos
+push 0.00694444
+mul
+add
+push 9.1
+sin
+push 0.0769231
+mul
+add
+push 9.1
+cos
+push 0.00591716
+mul
+add
+push 9.8
+sin
+push 0.0714286
+mul
+add
+push 9.8
+cos
+push 0.00510204
+mul
+add
+push 10.5
+sin
+push 0.0666667
+mul
+add
+push 10.5
+cos
+push 0.00444444
+mul
+add
+push 11.2
+sin
+push 0.0625
+mul
+add
+push 11.2
+cos
+push 0.00390625
+mul
+add
+in
+push 0
+jne loop
+out
+hlt
@@ -3,8 +3,6 @@
 
 #include <stdint.h>
 
-const int codelen = 1000; /* max code length in bytes */
-
 enum cmd {
         CMD_HLT,
         CMD_PUSH,
@@ -23,9 +21,248 @@ enum cmd {
         CMD_JB,
         CMD_JBE,
         CMD_JE,
-        CMD_JNE
+        CMD_JNE,
+
+        /* superinstructions, emitted by the assembler's peephole pass */
+        CMD_PUSH_ADD,
+        CMD_PUSH_MUL,
+        CMD_PUSH_JB,
+        CMD_OUT_HLT,
+
+        /* x -> sin x, cos x, after the above to keep their encodings */
+        CMD_SINCOS,
+
+        /* int64 instructions, see int_add() */
+        CMD_IPUSH,
+        CMD_IADD,
+        CMD_ISUB,
+        CMD_IMUL,
+        CMD_IDIV,
+        CMD_IJA,
+        CMD_IJAE,
+        CMD_IJB,
+        CMD_IJBE,
+        CMD_IJE,
+        CMD_IJNE,
+        CMD_ITOF,
+        CMD_FTOI,
+        CMD_IPUSH_ADD,          /* ipush <arg>; iadd */
+
+        /* registers and RAM, see reg_names and ram_size */
+        CMD_PUSH_REG,
+        CMD_POP_REG,
+        CMD_PUSH_MEM,
+        CMD_POP_MEM,
+
+        CMD_COUNT
 };
 
+/* mnemonics indexed by enum cmd, for reports and traces */
+static const char *const cmd_names[] = {"hlt", "push", "add", "sub", "mul",
+        "div", "out", "in", "sqrt", "sin", "cos", "jmp", "ja", "jae", "jb",
+        "jbe", "je", "jne", "push_add", "push_mul", "push_jb", "out_hlt",
+        "sincos", "ipush", "iadd", "isub", "imul", "idiv", "ija", "ijae", "ijb",
+        "ijbe", "ije", "ijne", "itof", "ftoi",
+        "ipush_add", "push_reg", "pop_reg", "push_mem", "pop_mem"};
+
+static_assert(sizeof(cmd_names)/sizeof(cmd_names[0]) == CMD_COUNT,
+                "cmd_names out of sync with enum cmd");
+
+/* whether an instruction carries an 8-byte immediate, int64_t for ipush
+ * and double for the others */
+static inline int cmd_has_arg(int opcode)
+{
+        switch (opcode) {
+                case CMD_PUSH:
+                case CMD_PUSH_ADD:
+                case CMD_PUSH_MUL:
+                case CMD_PUSH_JB:
+                case CMD_IPUSH:
+                case CMD_IPUSH_ADD:
+                        return 1;
+                default:
+                        return 0;
+        }
+}
+
+/* whether an instruction carries an int jump target (after the immediate) */
+static inline int cmd_is_jmp(int opcode)
+{
+        return (opcode >= CMD_JMP && opcode <= CMD_JNE) ||
+                opcode == CMD_PUSH_JB ||
+                (opcode >= CMD_IJA && opcode <= CMD_IJNE);
+}
+
+/*
+ * General-purpose registers, one byte after the opcode. push/pop [reg+imm]
+ * add a signed 32-bit displacement after it; [imm] is encoded with
+ * reg_none. Registers and RAM hold untyped slots like the stack, the
+ * base register of an address is read as a double and truncated, as
+ * push 3; pop rbx leaves it (itof an int64 index first).
+ */
+static const char *const reg_names[] = {"rax", "rbx", "rcx", "rdx"};
+const int reg_count = sizeof(reg_names) / sizeof(reg_names[0]);
+const int reg_none = 0xff;
+
+/* RAM in slots, addresses count slots from 0 */
+const int ram_size = 1 << 16;
+
+/* whether an instruction carries a register byte */
+static inline int cmd_has_reg(int opcode)
+{
+        return opcode >= CMD_PUSH_REG && opcode <= CMD_POP_MEM;
+}
+
+/* whether an instruction carries a displacement after its register */
+static inline int cmd_has_disp(int opcode)
+{
+        return opcode == CMD_PUSH_MEM || opcode == CMD_POP_MEM;
+}
+
+/* encoded length of an instruction in bytes, -1 for an unknown opcode */
+static inline int cmd_len(int opcode)
+{
+        if (opcode < 0 || opcode >= CMD_COUNT)
+                return -1;
+
+        int len = sizeof(char);
+        if (cmd_has_arg(opcode))
+                len += sizeof(double);
+        if (cmd_has_reg(opcode))
+                len += sizeof(char);
+        if (cmd_has_disp(opcode))
+                len += sizeof(int32_t);
+        if (cmd_is_jmp(opcode))
+                len += sizeof(int);
+        return len;
+}
+
+/* stack slots an instruction consumes */
+static inline int cmd_pops(int opcode)
+{
+        switch (opcode) {
+                case CMD_ADD:
+                case CMD_SUB:
+                case CMD_MUL:
+                case CMD_DIV:
+                case CMD_JA:
+                case CMD_JAE:
+                case CMD_JB:
+                case CMD_JBE:
+                case CMD_JE:
+                case CMD_JNE:
+                case CMD_IADD:
+                case CMD_ISUB:
+                case CMD_IMUL:
+                case CMD_IDIV:
+                case CMD_IJA:
+                case CMD_IJAE:
+                case CMD_IJB:
+                case CMD_IJBE:
+                case CMD_IJE:
+                case CMD_IJNE:
+                        return 2;
+                case CMD_SQRT:
+                case CMD_SIN:
+                case CMD_COS:
+                case CMD_PUSH_ADD:
+                case CMD_PUSH_MUL:
+                case CMD_PUSH_JB:
+                case CMD_SINCOS:
+                case CMD_ITOF:
+                case CMD_FTOI:
+                case CMD_IPUSH_ADD:
+                case CMD_POP_REG:
+                case CMD_POP_MEM:
+                        return 1;
+                default:
+                        return 0;
+        }
+}
+
+/* stack slots an instruction produces */
+static inline int cmd_pushes(int opcode)
+{
+        switch (opcode) {
+                case CMD_PUSH:
+                case CMD_IN:
+                case CMD_ADD:
+                case CMD_SUB:
+                case CMD_MUL:
+                case CMD_DIV:
+                case CMD_SQRT:
+                case CMD_SIN:
+                case CMD_COS:
+                case CMD_PUSH_ADD:
+                case CMD_PUSH_MUL:
+                case CMD_IPUSH:
+                case CMD_IADD:
+                case CMD_ISUB:
+                case CMD_IMUL:
+                case CMD_IDIV:
+                case CMD_ITOF:
+                case CMD_FTOI:
+                case CMD_IPUSH_ADD:
+                case CMD_PUSH_REG:
+                case CMD_PUSH_MEM:
+                        return 1;
+                case CMD_SINCOS:
+                        return 2;
+                default:
+                        return 0;
+        }
+}
+
+/* whether an instruction is one of the int64 ones */
+static inline int cmd_is_int(int opcode)
+{
+        return opcode >= CMD_IPUSH && opcode <= CMD_IPUSH_ADD;
+}
+
+/* whether execution may continue with the next instruction */
+static inline int cmd_falls_through(int opcode)
+{
+        return opcode != CMD_HLT && opcode != CMD_JMP &&
+                opcode != CMD_OUT_HLT;
+}
+
+/*
+ * The integer instructions read stack slots as int64_t bit patterns and
+ * wrap on overflow. Nothing traps: x / 0 is -1 and INT64_MIN / -1 is
+ * INT64_MIN, as on RISC-V, and ftoi gives INT64_MIN for NaN and doubles
+ * out of range, as cvttsd2si does.
+ */
+static inline int64_t int_add(int64_t b, int64_t a)
+{
+        return (int64_t) ((uint64_t) b + (uint64_t) a);
+}
+
+static inline int64_t int_sub(int64_t b, int64_t a)
+{
+        return (int64_t) ((uint64_t) b - (uint64_t) a);
+}
+
+static inline int64_t int_mul(int64_t b, int64_t a)
+{
+        return (int64_t) ((uint64_t) b * (uint64_t) a);
+}
+
+static inline int64_t int_div(int64_t b, int64_t a)
+{
+        if (a == 0)
+                return -1;
+        if (a == -1)
+                return (int64_t) (0 - (uint64_t) b);
+        return b / a;
+}
+
+static inline int64_t int_from_double(double val)
+{
+        if (!(val >= -0x1p63 && val < 0x1p63))
+                return INT64_MIN;
+        return (int64_t) val;
+}
+
 struct cmd_desc {
         enum cmd val;
         const char *name;
@@ -35,7 +272,31 @@ struct header {
         uint32_t signature;
         uint32_t v;
         uint32_t size;
-        uint32_t reserved;
+        uint32_t reserved;      /* enum header_flags */
+};
+
+enum header_flags {
+        HEADER_DEBUG = 1 << 0,  /* a line table follows the code */
+};
+
+/*
+ * The line table of a binary with HEADER_DEBUG sits right after the size
+ * bytes of code: a debug_header, nlines debug_line entries sorted by
+ * offset, then names_size bytes of NUL-terminated names, the first of
+ * them the source file.
+ */
+struct debug_header {
+        uint32_t nlines;
+        uint32_t names_size;
+};
+
+struct debug_line {
+        uint32_t offset;        /* first code byte of the line */
+        uint32_t line;          /* 1-based source line */
+        uint32_t label;         /* names offset of the label above the line,
+                                   debug_nolabel if there is none */
 };
 
+static const uint32_t debug_nolabel = UINT32_MAX;
+
 #endif
@@ -0,0 +1,30 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "optimizer.h"
+
+int main(int argc, char *argv[])
+{
+        const char *output = "program";
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "o:")) != -1) {
+                switch (opt) {
+                        case 'o':
+                                output = optarg;
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-o output] "
+                                                "binary\n", argv[0]);
+                                exit(1);
+                }
+        }
+
+        if (optind != argc - 1) {
+                fprintf(stderr, "error: binary not specified\n");
+                exit(1);
+        }
+
+        run_optimizer(argv[optind], output);
+        return 0;
+}
@@ -0,0 +1,549 @@
+/*
+ * optimizer - rewrite a binary into a faster equivalent one
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "optimizer.h"
+
+static void read_bin(const char *filename, struct opt_program *prog);
+static void read_lines(FILE *bin, struct opt_program *prog);
+static void decode_bin(struct opt_program *prog, const char *code, int size);
+static void write_bin(const char *filename, const struct opt_program *prog);
+static uint32_t remap_lines(const struct opt_program *prog,
+                const int *offsets, struct debug_line *lines);
+static int next_live(const struct opt_program *prog, int i);
+static void find_blocks(struct opt_program *prog);
+static int fold_constants(struct opt_program *prog);
+static int fold_insn(struct opt_insn *insn, double b, double a);
+static int thread_jumps(struct opt_program *prog);
+static int remove_unreachable(struct opt_program *prog);
+
+/*
+ * The binary is decoded into one struct opt_insn per instruction with
+ * jump targets as instruction indices. Passes only ever turn an
+ * instruction into another one or mark it dead, so a jump to a dead
+ * instruction means a jump to the next live one. The passes repeat until
+ * none of them changes anything, then the live instructions are encoded
+ * again with recomputed offsets. A line table from -g is kept, moved to
+ * the new offsets.
+ */
+void run_optimizer(const char *input, const char *output)
+{
+        struct opt_program prog = {};
+        read_bin(input, &prog);
+
+        int changed = 1;
+        while (changed) {
+                find_blocks(&prog);
+                changed = fold_constants(&prog);
+                changed |= thread_jumps(&prog);
+                changed |= remove_unreachable(&prog);
+        }
+
+        write_bin(output, &prog);
+        free(prog.insns);
+        free(prog.lines);
+        free(prog.names);
+}
+
+static void read_bin(const char *filename, struct opt_program *prog)
+{
+        FILE *bin = fopen(filename, "rb");
+        if (!bin) {
+                fprintf(stderr, "error: couldn't open file\n");
+                exit(1);
+        }
+
+        struct header header = {};
+        if (fread(&header, sizeof(struct header), 1, bin) != 1 ||
+                        header.signature != 0x61796b) {
+                fprintf(stderr, "error: unknown file format\n");
+                exit(1);
+        }
+
+        char *code = (char *) malloc(header.size + 1);
+        if (!code) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        if (fread(code, 1, header.size, bin) != header.size) {
+                fprintf(stderr, "error: truncated file\n");
+                exit(1);
+        }
+        if (header.reserved & HEADER_DEBUG)
+                read_lines(bin, prog);
+        fclose(bin);
+
+        decode_bin(prog, code, header.size);
+        free(code);
+}
+
+/*
+ * The line table after the code, see struct debug_header. The processor
+ * ignores a table that does not fit, so a bad one is dropped with a
+ * warning rather than failing the whole binary.
+ */
+static void read_lines(FILE *bin, struct opt_program *prog)
+{
+        struct debug_header debug = {};
+        if (fread(&debug, sizeof(debug), 1, bin) != 1 || !debug.names_size ||
+                        debug.nlines > (1u << 28) ||
+                        debug.names_size > (1u << 28)) {
+                fprintf(stderr, "warning: bad line table dropped\n");
+                return;
+        }
+
+        prog->lines = (struct debug_line *) malloc((debug.nlines + 1) *
+                        sizeof(struct debug_line));
+        prog->names = (char *) malloc(debug.names_size);
+        if (!prog->lines || !prog->names) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        if (fread(prog->lines, sizeof(struct debug_line), debug.nlines,
+                                bin) != debug.nlines ||
+                        fread(prog->names, 1, debug.names_size, bin) !=
+                                debug.names_size ||
+                        prog->names[debug.names_size - 1] != '\0') {
+                fprintf(stderr, "warning: bad line table dropped\n");
+                free(prog->lines);
+                free(prog->names);
+                prog->lines = NULL;
+                prog->names = NULL;
+                return;
+        }
+        prog->nlines = debug.nlines;
+        prog->names_size = debug.names_size;
+}
+
+static void decode_bin(struct opt_program *prog, const char *code, int size)
+{
+        int n = 0;
+        for (int pos = 0; pos < size; ++n) {
+                int len = cmd_len((unsigned char) code[pos]);
+                if (len < 0 || pos + len > size) {
+                        fprintf(stderr, "error: invalid instruction at %d\n",
+                                        pos);
+                        exit(1);
+                }
+                pos += len;
+        }
+
+        prog->insns = (struct opt_insn *) calloc(n + 1,
+                        sizeof(struct opt_insn));
+        int *index = (int *) malloc((size + 1) * sizeof(int));
+        if (!prog->insns || !index) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        prog->ninsns = n;
+
+        for (int pos = 0; pos <= size; ++pos)
+                index[pos] = -1;
+        index[size] = n;
+
+        for (int i = 0, pos = 0; i < n; ++i) {
+                struct opt_insn *insn = &prog->insns[i];
+                const char *ptr = code + pos;
+
+                insn->op = (unsigned char) *ptr++;
+                if (cmd_has_arg(insn->op)) {
+                        memcpy(&insn->arg, ptr, sizeof(double));
+                        ptr += sizeof(double);
+                }
+                if (cmd_has_reg(insn->op))
+                        insn->reg = (unsigned char) *ptr++;
+                if (cmd_has_disp(insn->op)) {
+                        memcpy(&insn->disp, ptr, sizeof(int32_t));
+                        ptr += sizeof(int32_t);
+                }
+                if (cmd_is_jmp(insn->op))
+                        memcpy(&insn->target, ptr, sizeof(int));
+                insn->live = 1;
+
+                index[pos] = i;
+                pos += cmd_len(insn->op);
+        }
+
+        for (int i = 0, pos = 0; i < n; pos += cmd_len(prog->insns[i].op),
+                        ++i) {
+                struct opt_insn *insn = &prog->insns[i];
+                if (!cmd_is_jmp(insn->op))
+                        continue;
+                if (insn->target < 0 || insn->target > size ||
+                                index[insn->target] < 0) {
+                        fprintf(stderr, "error: invalid jump target at %d\n",
+                                        pos);
+                        exit(1);
+                }
+                insn->target = index[insn->target];
+        }
+
+        /* entries that do not start an instruction are dropped */
+        uint32_t nlines = 0;
+        for (uint32_t k = 0; k < prog->nlines; ++k) {
+                struct debug_line entry = prog->lines[k];
+                if (entry.offset >= (uint32_t) size ||
+                                index[entry.offset] < 0)
+                        continue;
+                entry.offset = index[entry.offset];
+                prog->lines[nlines++] = entry;
+        }
+        prog->nlines = nlines;
+        free(index);
+}
+
+static void write_bin(const char *filename, const struct opt_program *prog)
+{
+        int n = prog->ninsns;
+        int *offsets = (int *) malloc((n + 1) * sizeof(int));
+        if (!offsets) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        /* a dead instruction gets the offset of the next live one */
+        int size = 0;
+        for (int i = 0; i < n; ++i) {
+                offsets[i] = size;
+                if (prog->insns[i].live)
+                        size += cmd_len(prog->insns[i].op);
+        }
+        offsets[n] = size;
+
+        char *code = (char *) malloc(size + 1);
+        if (!code) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        char *ptr = code;
+        for (int i = 0; i < n; ++i) {
+                const struct opt_insn *insn = &prog->insns[i];
+                if (!insn->live)
+                        continue;
+
+                *ptr++ = insn->op;
+                if (cmd_has_arg(insn->op)) {
+                        memcpy(ptr, &insn->arg, sizeof(double));
+                        ptr += sizeof(double);
+                }
+                if (cmd_has_reg(insn->op))
+                        *ptr++ = insn->reg;
+                if (cmd_has_disp(insn->op)) {
+                        memcpy(ptr, &insn->disp, sizeof(int32_t));
+                        ptr += sizeof(int32_t);
+                }
+                if (cmd_is_jmp(insn->op)) {
+                        memcpy(ptr, &offsets[insn->target], sizeof(int));
+                        ptr += sizeof(int);
+                }
+        }
+
+        FILE *bin = fopen(filename, "wb");
+        if (!bin) {
+                fprintf(stderr, "error: couldn't open file\n");
+                exit(1);
+        }
+
+        struct header header = {0x61796b, 1, (uint32_t) size,
+                prog->lines ? (uint32_t) HEADER_DEBUG : 0};
+        fwrite(&header, 1, sizeof(struct header), bin);
+        fwrite(code, size, 1, bin);
+        if (prog->lines) {
+                struct debug_line *lines = (struct debug_line *) malloc(
+                                (prog->nlines + 1) *
+                                sizeof(struct debug_line));
+                if (!lines) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+                struct debug_header debug = {remap_lines(prog, offsets,
+                                lines), prog->names_size};
+                fwrite(&debug, sizeof(debug), 1, bin);
+                fwrite(lines, sizeof(struct debug_line), debug.nlines, bin);
+                fwrite(prog->names, 1, prog->names_size, bin);
+                free(lines);
+        }
+        fclose(bin);
+
+        free(code);
+        free(offsets);
+}
+
+/*
+ * The line table with byte offsets of the new code. A line whose
+ * instructions all died lands on the next live one; if that has a line
+ * of its own, or there is no live code after it, the entry goes.
+ */
+static uint32_t remap_lines(const struct opt_program *prog,
+                const int *offsets, struct debug_line *lines)
+{
+        int size = offsets[prog->ninsns];
+        uint32_t n = 0;
+        for (uint32_t k = 0; k < prog->nlines; ++k) {
+                struct debug_line entry = prog->lines[k];
+                entry.offset = offsets[entry.offset];
+                if ((int) entry.offset >= size)
+                        continue;
+                if (n && lines[n - 1].offset == entry.offset)
+                        --n;
+                lines[n++] = entry;
+        }
+        return n;
+}
+
+/* the first live instruction at or after i, ninsns if there is none */
+static int next_live(const struct opt_program *prog, int i)
+{
+        while (i < prog->ninsns && !prog->insns[i].live)
+                ++i;
+        return i;
+}
+
+/* blocks start at the entry, at jump targets and after jumps and hlt */
+static void find_blocks(struct opt_program *prog)
+{
+        int n = prog->ninsns;
+        for (int i = 0; i < n; ++i)
+                prog->insns[i].leader = 0;
+
+        int entry = next_live(prog, 0);
+        if (entry < n)
+                prog->insns[entry].leader = 1;
+
+        int ends_block = 0;
+        for (int i = 0; i < n; ++i) {
+                struct opt_insn *insn = &prog->insns[i];
+                if (!insn->live)
+                        continue;
+                if (ends_block)
+                        insn->leader = 1;
+
+                ends_block = cmd_is_jmp(insn->op) ||
+                        !cmd_falls_through(insn->op);
+                if (cmd_is_jmp(insn->op)) {
+                        int target = next_live(prog, insn->target);
+                        if (target < n)
+                                prog->insns[target].leader = 1;
+                }
+        }
+}
+
+/*
+ * Within a block, consts holds the pushes whose values are the top
+ * slots of the stack. An instruction whose operands all come from there
+ * becomes a push of its result, or a jmp or nothing if it is a
+ * conditional jump, and the pushes die. Anything that leaves an unknown
+ * value on top empties consts, and so does out, which needs the value it
+ * prints to stay pushed.
+ */
+static int fold_constants(struct opt_program *prog)
+{
+        int n = prog->ninsns;
+        int *consts = (int *) malloc((n + 1) * sizeof(int));
+        if (!consts) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        int nconsts = 0;
+        int changed = 0;
+        for (int i = 0; i < n; ++i) {
+                struct opt_insn *insn = &prog->insns[i];
+                if (!insn->live)
+                        continue;
+                if (insn->leader)
+                        nconsts = 0;
+
+                if (insn->op == CMD_PUSH) {
+                        consts[nconsts++] = i;
+                        continue;
+                }
+
+                int pops = cmd_pops(insn->op);
+                if (pops == 0 || nconsts < pops) {
+                        nconsts = 0;
+                        continue;
+                }
+
+                double a = prog->insns[consts[nconsts - 1]].arg;
+                double b = pops > 1 ? prog->insns[consts[nconsts - 2]].arg : 0;
+                if (!fold_insn(insn, b, a)) {
+                        nconsts = 0;
+                        continue;
+                }
+
+                for (int k = 0; k < pops; ++k)
+                        prog->insns[consts[--nconsts]].live = 0;
+                if (insn->live && insn->op == CMD_PUSH)
+                        consts[nconsts++] = i;
+                else
+                        nconsts = 0;
+                changed = 1;
+        }
+
+        free(consts);
+        return changed;
+}
+
+/*
+ * Rewrite insn for constant operands (a on top, b below it), returns 0
+ * if it cannot be folded. Results are computed with the same libm calls
+ * the processor makes, so they are bit-identical.
+ */
+static int fold_insn(struct opt_insn *insn, double b, double a)
+{
+        int taken = 0;
+        switch (insn->op) {
+                case CMD_ADD:
+                        insn->arg = b + a;
+                        break;
+                case CMD_SUB:
+                        insn->arg = b - a;
+                        break;
+                case CMD_MUL:
+                        insn->arg = b * a;
+                        break;
+                case CMD_DIV:
+                        insn->arg = b / a;
+                        break;
+                case CMD_SQRT:
+                        insn->arg = sqrt(a);
+                        break;
+                case CMD_SIN:
+                        insn->arg = sin(a);
+                        break;
+                case CMD_COS:
+                        insn->arg = cos(a);
+                        break;
+                case CMD_PUSH_ADD:
+                        insn->arg = a + insn->arg;
+                        break;
+                case CMD_PUSH_MUL:
+                        insn->arg = a * insn->arg;
+                        break;
+                case CMD_JA:
+                        taken = b > a;
+                        goto jump;
+                case CMD_JAE:
+                        taken = b >= a;
+                        goto jump;
+                case CMD_JB:
+                        taken = b < a;
+                        goto jump;
+                case CMD_JBE:
+                        taken = b <= a;
+                        goto jump;
+                case CMD_JE:
+                        taken = b == a;
+                        goto jump;
+                case CMD_JNE:
+                        taken = b != a;
+                        goto jump;
+                case CMD_PUSH_JB:
+                        taken = a < insn->arg;
+                        goto jump;
+                default:
+                        return 0;
+        }
+        insn->op = CMD_PUSH;
+        return 1;
+
+jump:
+        if (taken)
+                insn->op = CMD_JMP;
+        else
+                insn->live = 0;
+        return 1;
+}
+
+/*
+ * Jumps to a jmp go straight to its target, a jmp to hlt or out_hlt
+ * becomes that instruction, and a jmp to the next instruction goes away.
+ */
+static int thread_jumps(struct opt_program *prog)
+{
+        int n = prog->ninsns;
+        int changed = 0;
+
+        for (int i = 0; i < n; ++i) {
+                struct opt_insn *insn = &prog->insns[i];
+                if (!insn->live || !cmd_is_jmp(insn->op))
+                        continue;
+
+                int first = next_live(prog, insn->target);
+                int target = first;
+                for (int hops = 0; target < n && hops < n &&
+                                prog->insns[target].op == CMD_JMP; ++hops)
+                        target = next_live(prog, prog->insns[target].target);
+                insn->target = target;
+                changed |= target != first;
+
+                if (insn->op != CMD_JMP)
+                        continue;
+                if (target == n) {
+                        insn->op = CMD_HLT;
+                        changed = 1;
+                } else if (prog->insns[target].op == CMD_HLT ||
+                                prog->insns[target].op == CMD_OUT_HLT) {
+                        insn->op = prog->insns[target].op;
+                        changed = 1;
+                } else if (target == next_live(prog, i + 1)) {
+                        insn->live = 0;
+                        changed = 1;
+                }
+        }
+        return changed;
+}
+
+/* kill everything that no path from the entry reaches */
+static int remove_unreachable(struct opt_program *prog)
+{
+        int n = prog->ninsns;
+        int *work = (int *) malloc((2 * n + 1) * sizeof(int));
+        if (!work) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        for (int i = 0; i < n; ++i)
+                prog->insns[i].reachable = 0;
+
+        int nwork = 0;
+        int entry = next_live(prog, 0);
+        if (entry < n)
+                work[nwork++] = entry;
+
+        while (nwork > 0) {
+                int i = work[--nwork];
+                struct opt_insn *insn = &prog->insns[i];
+                if (insn->reachable)
+                        continue;
+                insn->reachable = 1;
+
+                int next = next_live(prog, i + 1);
+                if (cmd_falls_through(insn->op) && next < n &&
+                                !prog->insns[next].reachable)
+                        work[nwork++] = next;
+                int target = cmd_is_jmp(insn->op) ?
+                        next_live(prog, insn->target) : n;
+                if (target < n && !prog->insns[target].reachable)
+                        work[nwork++] = target;
+        }
+
+        int changed = 0;
+        for (int i = 0; i < n; ++i) {
+                if (prog->insns[i].live && !prog->insns[i].reachable) {
+                        prog->insns[i].live = 0;
+                        changed = 1;
+                }
+        }
+
+        free(work);
+        return changed;
+}
@@ -0,0 +1,30 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "common.h"
+
+/* one instruction of the binary being optimized */
+struct opt_insn {
+        int op;
+        int target;             /* instruction index, ninsns for the end */
+        double arg;
+        int reg;                /* register byte and displacement, as encoded */
+        int32_t disp;
+        int live;               /* 0 once removed */
+        int leader;             /* starts a basic block */
+        int reachable;
+};
+
+struct opt_program {
+        struct opt_insn *insns;
+        int ninsns;
+        struct debug_line *lines;       /* line table, offset is an insn
+                                           index here, NULL without -g */
+        uint32_t nlines;
+        char *names;
+        uint32_t names_size;
+};
+
+void run_optimizer(const char *input, const char *output);
+
+#endif
@@ -0,0 +1,474 @@
+/*
+ * batch - run one program over many input sets in SIMD lockstep
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "processor.h"
+#include "stack.h"
+#include "decode.h"
+#include "batch.h"
+#include "fastio.h"
+#include "fastmath.h"
+
+/*
+ * Input sets are read one per line from stdin and run batch_lanes at a
+ * time. The operand stack is a structure of arrays: slot k of every lane
+ * is contiguous, so each instruction is a loop over lanes that the
+ * compiler turns into AVX2/AVX-512 code (selected at run time through
+ * target_clones). Stack depths are static (decode_depths()), so lanes
+ * at the same instruction agree on which slots to use.
+ *
+ * Lanes stay converged on one pc until a conditional jump splits them.
+ * After that every lane keeps its own pc, the lowest pc among running
+ * lanes executes next with the others masked off, and the lanes merge
+ * again once they all reach the same pc.
+ */
+const int batch_lanes = 128;
+
+struct lane_out {
+        char *data;
+        size_t size;
+        size_t capacity;
+};
+
+struct batch {
+        const struct processor *processor;
+        int *depth;
+        int max_depth;
+        double *slots;          /* slot k of lane l at [k * batch_lanes + l] */
+        int64_t *mask;          /* lanes executing the current insn */
+        int64_t *active;        /* lanes that have not halted */
+        int64_t *cond;          /* per-lane jump outcome */
+        int *pcs;               /* per-lane pc while diverged */
+        char **lines;           /* input set of every lane */
+        size_t *line_caps;
+        const char **cursor;
+        struct lane_out *out;
+        int nlanes;
+        int fast;               /* PROC_FAST_MATH: sin/cos across lanes */
+        int shortest;           /* PROC_SHORTEST: lane output round-trips */
+};
+
+static void batch_ctor(struct batch *batch, const struct processor *processor,
+                int flags);
+static void batch_dtor(struct batch *batch);
+static int batch_read(struct batch *batch);
+static void batch_execute(struct batch *batch);
+static int batch_schedule(struct batch *batch, int *converged);
+static void batch_trig(struct batch *batch, int op, double *a, double *top);
+static double lane_in(struct batch *batch, int lane);
+static void lane_out(struct batch *batch, int lane, double val);
+static void *batch_alloc(size_t size);
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BATCH_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BATCH_TARGETS
+#endif
+
+#define SLOT(K) (batch->slots + (size_t) (K) * batch_lanes)
+
+#define LANES(EXPR) for (int l = 0; l < batch_lanes; ++l) {             \
+                            EXPR;                                       \
+                    }
+
+#define BATCH_BIN(OP) LANES(b[l] = m[l] ? b[l] OP a[l] : b[l])
+
+#define BATCH_IMM(OP) LANES(a[l] = m[l] ? a[l] OP insn->arg : a[l])
+
+#define BATCH_JMP(OP) LANES(batch->cond[l] = m[l] & -(int64_t) (b[l] OP a[l]))
+
+/* the int64 instructions, FN is one of the common.h int_ functions */
+#define BATCH_INT(FN) LANES(b[l] = m[l] ?                               \
+                            int_slot(FN(slot_int(b[l]), slot_int(a[l]))) : \
+                            b[l])
+
+#define BATCH_IJMP(OP) LANES(batch->cond[l] = m[l] &                    \
+                             -(int64_t) (slot_int(b[l]) OP slot_int(a[l])))
+
+void run_batch(struct processor *processor, int flags)
+{
+        if (!processor || !processor->prog || !processor->prog->insns) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        struct batch batch = {};
+        batch_ctor(&batch, processor, flags);
+
+        while (batch_read(&batch) > 0) {
+                batch_execute(&batch);
+                for (int l = 0; l < batch.nlanes; ++l) {
+                        fwrite(batch.out[l].data, 1, batch.out[l].size, stdout);
+                        fputc('\n', stdout);
+                }
+        }
+
+        batch_dtor(&batch);
+}
+
+static void batch_ctor(struct batch *batch, const struct processor *processor,
+                int flags)
+{
+        batch->processor = processor;
+        batch->fast = (flags & PROC_FAST_MATH) != 0;
+        batch->shortest = (flags & PROC_SHORTEST) != 0;
+        batch->depth = (int *) batch_alloc(processor->prog->ninsns *
+                        sizeof(int));
+        batch->max_depth = decode_depths(processor->prog, batch->depth);
+        if (batch->max_depth < 0) {
+                fprintf(stderr, "error: batch mode needs a static stack depth\n");
+                exit(1);
+        }
+        for (int i = 0; i < processor->prog->ninsns; ++i) {
+                if (cmd_has_reg(processor->prog->insns[i].op)) {
+                        fprintf(stderr, "error: batch mode has no registers "
+                                        "or RAM\n");
+                        exit(1);
+                }
+        }
+
+        size_t nslots = batch->max_depth > 0 ? batch->max_depth : 1;
+        batch->slots = (double *) aligned_alloc(64,
+                        nslots * batch_lanes * sizeof(double));
+        if (!batch->slots) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        batch->mask = (int64_t *) batch_alloc(batch_lanes * sizeof(int64_t));
+        batch->active = (int64_t *) batch_alloc(batch_lanes * sizeof(int64_t));
+        batch->cond = (int64_t *) batch_alloc(batch_lanes * sizeof(int64_t));
+        batch->pcs = (int *) batch_alloc(batch_lanes * sizeof(int));
+        batch->lines = (char **) batch_alloc(batch_lanes * sizeof(char *));
+        batch->line_caps = (size_t *) batch_alloc(batch_lanes * sizeof(size_t));
+        batch->cursor = (const char **) batch_alloc(batch_lanes *
+                        sizeof(const char *));
+        batch->out = (struct lane_out *) batch_alloc(batch_lanes *
+                        sizeof(struct lane_out));
+}
+
+static void batch_dtor(struct batch *batch)
+{
+        for (int l = 0; l < batch_lanes; ++l) {
+                free(batch->lines[l]);
+                free(batch->out[l].data);
+        }
+        free(batch->depth);
+        free(batch->slots);
+        free(batch->mask);
+        free(batch->active);
+        free(batch->cond);
+        free(batch->pcs);
+        free(batch->lines);
+        free(batch->line_caps);
+        free(batch->cursor);
+        free(batch->out);
+}
+
+static void *batch_alloc(size_t size)
+{
+        void *ptr = calloc(1, size ? size : 1);
+        if (!ptr) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        return ptr;
+}
+
+/* read up to batch_lanes input lines, returns the number of lanes */
+static int batch_read(struct batch *batch)
+{
+        batch->nlanes = 0;
+        while (batch->nlanes < batch_lanes) {
+                int l = batch->nlanes;
+                if (getline(&batch->lines[l], &batch->line_caps[l], stdin) < 0)
+                        break;
+                batch->cursor[l] = batch->lines[l];
+                batch->out[l].size = 0;
+                ++batch->nlanes;
+        }
+        return batch->nlanes;
+}
+
+BATCH_TARGETS
+static void batch_execute(struct batch *batch)
+{
+        const struct insn *insns = batch->processor->prog->insns;
+        int64_t *m = batch->mask;
+        int converged = 1;
+        int cur = 0;
+
+        for (int l = 0; l < batch_lanes; ++l)
+                batch->active[l] = m[l] = -(int64_t) (l < batch->nlanes);
+
+        for (;;) {
+                const struct insn *insn = &insns[cur];
+                int depth = batch->depth[cur];
+                double *a = SLOT(depth - 1);
+                double *b = SLOT(depth - 2);
+                double *top = SLOT(depth);
+                int next = cur + 1;
+                int jump = 0;
+                int halt = 0;
+
+                switch (insn->op) {
+                        case CMD_HLT:
+                                halt = 1;
+                                break;
+                        case CMD_PUSH:
+                        case CMD_IPUSH:
+                                LANES(top[l] = m[l] ? insn->arg : top[l]);
+                                break;
+                        case CMD_ADD:
+                                BATCH_BIN(+);
+                                break;
+                        case CMD_SUB:
+                                BATCH_BIN(-);
+                                break;
+                        case CMD_MUL:
+                                BATCH_BIN(*);
+                                break;
+                        case CMD_DIV:
+                                BATCH_BIN(/);
+                                break;
+                        case CMD_SQRT:
+                                LANES(a[l] = m[l] ? sqrt(a[l]) : a[l]);
+                                break;
+                        case CMD_SIN:
+                        case CMD_COS:
+                        case CMD_SINCOS:
+                                batch_trig(batch, insn->op, a, top);
+                                break;
+                        case CMD_IN:
+                                for (int l = 0; l < batch_lanes; ++l)
+                                        if (m[l])
+                                                top[l] = lane_in(batch, l);
+                                break;
+                        case CMD_OUT:
+                        case CMD_OUT_HLT:
+                                for (int l = 0; l < batch_lanes; ++l)
+                                        if (m[l] && depth > 0)
+                                                lane_out(batch, l, a[l]);
+                                halt = insn->op == CMD_OUT_HLT;
+                                break;
+                        case CMD_JMP:
+                                next = insn->target;
+                                break;
+                        case CMD_JA:
+                                BATCH_JMP(>);
+                                jump = 1;
+                                break;
+                        case CMD_JAE:
+                                BATCH_JMP(>=);
+                                jump = 1;
+                                break;
+                        case CMD_JB:
+                                BATCH_JMP(<);
+                                jump = 1;
+                                break;
+                        case CMD_JBE:
+                                BATCH_JMP(<=);
+                                jump = 1;
+                                break;
+                        case CMD_JE:
+                                BATCH_JMP(==);
+                                jump = 1;
+                                break;
+                        case CMD_JNE:
+                                BATCH_JMP(!=);
+                                jump = 1;
+                                break;
+                        case CMD_PUSH_ADD:
+                                BATCH_IMM(+);
+                                break;
+                        case CMD_PUSH_MUL:
+                                BATCH_IMM(*);
+                                break;
+                        case CMD_PUSH_JB:
+                                LANES(batch->cond[l] = m[l] &
+                                                -(int64_t) (a[l] < insn->arg));
+                                jump = 1;
+                                break;
+                        case CMD_IADD:
+                                BATCH_INT(int_add);
+                                break;
+                        case CMD_ISUB:
+                                BATCH_INT(int_sub);
+                                break;
+                        case CMD_IMUL:
+                                BATCH_INT(int_mul);
+                                break;
+                        case CMD_IDIV:
+                                BATCH_INT(int_div);
+                                break;
+                        case CMD_IJA:
+                                BATCH_IJMP(>);
+                                jump = 1;
+                                break;
+                        case CMD_IJAE:
+                                BATCH_IJMP(>=);
+                                jump = 1;
+                                break;
+                        case CMD_IJB:
+                                BATCH_IJMP(<);
+                                jump = 1;
+                                break;
+                        case CMD_IJBE:
+                                BATCH_IJMP(<=);
+                                jump = 1;
+                                break;
+                        case CMD_IJE:
+                                BATCH_IJMP(==);
+                                jump = 1;
+                                break;
+                        case CMD_IJNE:
+                                BATCH_IJMP(!=);
+                                jump = 1;
+                                break;
+                        case CMD_IPUSH_ADD:
+                                LANES(a[l] = m[l] ? int_slot(int_add(
+                                                slot_int(a[l]),
+                                                slot_int(insn->arg))) : a[l]);
+                                break;
+                        case CMD_ITOF:
+                                LANES(a[l] = m[l] ? (double) slot_int(a[l]) :
+                                                a[l]);
+                                break;
+                        case CMD_FTOI:
+                                LANES(a[l] = m[l] ?
+                                                int_slot(int_from_double(a[l])) :
+                                                a[l]);
+                                break;
+                }
+
+                if (halt) {
+                        for (int l = 0; l < batch_lanes; ++l)
+                                batch->active[l] &= ~m[l];
+                        if (converged)
+                                return;
+                } else if (jump && converged) {
+                        int taken = 0, running = 0;
+                        for (int l = 0; l < batch_lanes; ++l) {
+                                taken += batch->cond[l] != 0;
+                                running += m[l] != 0;
+                        }
+                        if (taken == running) {
+                                cur = insn->target;
+                                continue;
+                        }
+                        if (taken == 0) {
+                                cur = next;
+                                continue;
+                        }
+                        converged = 0;
+                        for (int l = 0; l < batch_lanes; ++l)
+                                batch->pcs[l] = batch->cond[l] ?
+                                        insn->target : next;
+                } else if (converged) {
+                        cur = next;
+                        continue;
+                } else {
+                        for (int l = 0; l < batch_lanes; ++l) {
+                                if (!m[l])
+                                        continue;
+                                batch->pcs[l] = jump && batch->cond[l] ?
+                                        insn->target : next;
+                        }
+                }
+
+                cur = batch_schedule(batch, &converged);
+                if (cur < 0)
+                        return;
+        }
+}
+
+/*
+ * sin or cos of a, or for sincos sin into a and cos into top. With
+ * PROC_FAST_MATH and every running lane within fast_trig_limit, the
+ * fastmath.h kernel runs across all lanes at once; otherwise every lane
+ * calls the scalar function.
+ */
+BATCH_TARGETS
+static void batch_trig(struct batch *batch, int op, double *a, double *top)
+{
+        const int64_t *m = batch->mask;
+        int64_t far = 0;
+        LANES(far |= m[l] & -(int64_t) !(fabs(a[l]) <= fast_trig_limit));
+
+        if (batch->fast && !far) {
+                for (int l = 0; l < batch_lanes; ++l) {
+                        double s = 0, c = 0;
+                        fast_sincos_kernel(a[l], &s, &c);
+                        if (op == CMD_SINCOS)
+                                top[l] = m[l] ? c : top[l];
+                        a[l] = m[l] ? (op == CMD_COS ? c : s) : a[l];
+                }
+                return;
+        }
+
+        for (int l = 0; l < batch_lanes; ++l) {
+                if (!m[l])
+                        continue;
+                if (op == CMD_SINCOS)
+                        math_sincos(a[l], batch->fast, &a[l], &top[l]);
+                else if (op == CMD_SIN)
+                        a[l] = math_sin(a[l], batch->fast);
+                else
+                        a[l] = math_cos(a[l], batch->fast);
+        }
+}
+
+/* pick the lowest pc among running lanes, -1 once every lane halted */
+static int batch_schedule(struct batch *batch, int *converged)
+{
+        int cur = -1;
+        for (int l = 0; l < batch_lanes; ++l)
+                if (batch->active[l] && (cur < 0 || batch->pcs[l] < cur))
+                        cur = batch->pcs[l];
+        if (cur < 0)
+                return -1;
+
+        *converged = 1;
+        for (int l = 0; l < batch_lanes; ++l) {
+                batch->mask[l] = batch->active[l] &
+                        -(int64_t) (batch->pcs[l] == cur);
+                if (batch->active[l] && !batch->mask[l])
+                        *converged = 0;
+        }
+        return cur;
+}
+
+static double lane_in(struct batch *batch, int lane)
+{
+        char *end = NULL;
+        double val = strtod(batch->cursor[lane], &end);
+        if (end == batch->cursor[lane])
+                return 0;
+        batch->cursor[lane] = end;
+        return val;
+}
+
+static void lane_out(struct batch *batch, int lane, double val)
+{
+        struct lane_out *out = &batch->out[lane];
+        if (out->size + fastio_maxlen > out->capacity) {
+                size_t capacity = out->capacity ? out->capacity * 2 : 256;
+                out->data = (char *) realloc(out->data, capacity);
+                if (!out->data) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+                out->capacity = capacity;
+        }
+
+        if (out->size)
+                out->data[out->size++] = ' ';
+        out->size += fastio_format(out->data + out->size, val,
+                        batch->shortest);
+}
@@ -0,0 +1,10 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "processor.h"
+
+/* run the program once per input line of stdin, many lines in lockstep;
+ * flags are enum proc_flags, of which only PROC_FAST_MATH matters */
+void run_batch(struct processor *processor, int flags);
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * checkpoint - save and resume processor state
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "processor.h"
+#include "checkpoint.h"
+
+/*
+ * A checkpoint file is this header followed by size doubles, the stack
+ * from the bottom up, and the RAM if the program has any. The program is
+ * identified by a copy of its header and a hash of its code, ip is
+ * stored as a byte offset into the code so that it does not depend on
+ * how the binary is decoded.
+ */
+struct checkpoint {
+        uint32_t signature;
+        uint32_t v;
+        struct header prog;
+        uint64_t hash;          /* FNV-1a of the code */
+        int32_t ip;
+        int32_t size;
+        double regs[reg_count];
+        int32_t ram;            /* slots after the stack, 0 or ram_size */
+        int32_t reserved;
+};
+
+static const uint32_t checkpoint_signature = 0x706b63;
+static const uint32_t checkpoint_version = 2;
+
+static struct processor *running;
+static volatile sig_atomic_t last_signal;
+
+static uint64_t hash_code(const struct program *prog);
+static int find_insn(const struct program *prog, int offset);
+static void on_signal(int sig);
+static int sync_dir(const char *filename);
+
+/*
+ * The snapshot goes to a temporary file that is renamed over filename,
+ * so a crash while saving leaves the previous checkpoint intact. The file
+ * is on disk before the rename and the rename before this returns, which
+ * holds across a power loss too.
+ */
+int checkpoint_save(const struct processor *processor, const char *filename)
+{
+        if (!processor || !processor->prog || !filename) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        const struct program *prog = processor->prog;
+        struct checkpoint ckpt = {};
+        ckpt.signature = checkpoint_signature;
+        ckpt.v = checkpoint_version;
+        memcpy(&ckpt.prog, prog->image, sizeof(struct header));
+        ckpt.hash = hash_code(prog);
+        ckpt.ip = prog->offsets[processor->ip];
+        ckpt.size = processor->stk.size;
+        memcpy(ckpt.regs, processor->regs, sizeof(ckpt.regs));
+        ckpt.ram = processor->ram ? ram_size : 0;
+
+        size_t len = strlen(filename);
+        char *tmp = (char *) malloc(len + sizeof(".tmp"));
+        if (!tmp) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        memcpy(tmp, filename, len);
+        memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+        FILE *out = fopen(tmp, "wb");
+        if (!out) {
+                free(tmp);
+                return PROC_ERR_OPEN;
+        }
+        fwrite(&ckpt, sizeof(ckpt), 1, out);
+        fwrite(processor->stk.data, sizeof(double), ckpt.size, out);
+        if (processor->ram)
+                fwrite(processor->ram, sizeof(double), ckpt.ram, out);
+        int failed = fflush(out) != 0 || ferror(out);
+        failed |= fsync(fileno(out)) != 0;
+        failed |= fclose(out) != 0;
+        if (!failed)
+                failed = rename(tmp, filename) != 0;
+        if (failed)
+                unlink(tmp);
+        else
+                failed = sync_dir(filename) != 0;
+
+        free(tmp);
+        return failed ? PROC_ERR_OPEN : PROC_OK;
+}
+
+/*
+ * Map the snapshot and continue from it: the stack is copied straight
+ * out of the mapping, so resuming costs one read of the file.
+ */
+int checkpoint_load(struct processor *processor, const char *filename)
+{
+        if (!processor || !processor->prog || !filename) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0)
+                return PROC_ERR_OPEN;
+
+        struct stat st = {};
+        if (fstat(fd, &st) < 0 ||
+                        (size_t) st.st_size < sizeof(struct checkpoint)) {
+                close(fd);
+                return PROC_ERR_CHECKPOINT;
+        }
+
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+                return PROC_ERR_OPEN;
+
+        const struct program *prog = processor->prog;
+        const struct checkpoint *ckpt = (const struct checkpoint *) map;
+        int ram = processor->ram ? ram_size : 0;
+        int ip = -1;
+        if (ckpt->signature == checkpoint_signature &&
+                        ckpt->v == checkpoint_version &&
+                        ckpt->size >= 0 && ckpt->ram == ram &&
+                        (size_t) ckpt->size + ram <= (st.st_size -
+                                sizeof(struct checkpoint)) / sizeof(double) &&
+                        !memcmp(&ckpt->prog, prog->image,
+                                sizeof(struct header)) &&
+                        ckpt->hash == hash_code(prog))
+                ip = find_insn(prog, ckpt->ip);
+
+        if (ip >= 0) {
+                processor_reset(processor);
+                dstack_reserve(&processor->stk, ckpt->size);
+                const double *data = (const double *) (ckpt + 1);
+                memcpy(processor->stk.data, data,
+                                ckpt->size * sizeof(double));
+                processor->stk.size = ckpt->size;
+                memcpy(processor->regs, ckpt->regs, sizeof(ckpt->regs));
+                if (ram)
+                        memcpy(processor->ram, data + ckpt->size,
+                                        ram * sizeof(double));
+                processor->ip = ip;
+        }
+
+        munmap(map, st.st_size);
+        return ip >= 0 ? PROC_OK : PROC_ERR_CHECKPOINT;
+}
+
+/*
+ * SIGUSR1 asks for a checkpoint, SIGTERM and SIGINT for a last one before
+ * exiting. The handler only raises processor->stop; the interpreter checks
+ * it on every taken jump, so it stops within one pass of any loop and the
+ * caller saves from there. The handlers do not restart system calls, so
+ * an in blocked on input gives up and stops before the in.
+ */
+void checkpoint_signals(struct processor *processor)
+{
+        running = processor;
+
+        struct sigaction sa = {};
+        sa.sa_handler = on_signal;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        sigaction(SIGINT, &sa, NULL);
+}
+
+int checkpoint_last_signal(void)
+{
+        return last_signal;
+}
+
+static void on_signal(int sig)
+{
+        last_signal = sig;
+        running->stop = 1;
+}
+
+/* fsync the directory holding filename, which makes a rename durable */
+static int sync_dir(const char *filename)
+{
+        const char *slash = strrchr(filename, '/');
+        char *dir = slash ? strndup(filename, slash - filename + 1) :
+                strdup(".");
+        if (!dir) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        int fd = open(dir, O_RDONLY | O_DIRECTORY);
+        free(dir);
+        if (fd < 0)
+                return -1;
+        int failed = fsync(fd);
+        close(fd);
+        return failed;
+}
+
+static uint64_t hash_code(const struct program *prog)
+{
+        uint64_t hash = 0xcbf29ce484222325;
+        for (int i = 0; i < prog->size; ++i) {
+                hash ^= (unsigned char) prog->code[i];
+                hash *= 0x100000001b3;
+        }
+        return hash;
+}
+
+/* index of the insn at byte offset, -1 if none starts there */
+static int find_insn(const struct program *prog, int offset)
+{
+        int lo = 0, hi = prog->ninsns - 1;
+        while (lo <= hi) {
+                int mid = lo + (hi - lo) / 2;
+                if (prog->offsets[mid] == offset)
+                        return mid;
+                if (prog->offsets[mid] < offset)
+                        lo = mid + 1;
+                else
+                        hi = mid - 1;
+        }
+        return -1;
+}
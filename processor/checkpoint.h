@@ -0,0 +1,18 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "processor.h"
+
+/*
+ * Snapshot of a running processor: the program it belongs to, ip, the
+ * operand stack, the registers and RAM. I/O already done is not part of
+ * it.
+ */
+int checkpoint_save(const struct processor *processor, const char *filename);
+int checkpoint_load(struct processor *processor, const char *filename);
+
+/* checkpoint signals stop processor at its next jump, see checkpoint.cpp */
+void checkpoint_signals(struct processor *processor);
+int checkpoint_last_signal(void);
+
+#endif
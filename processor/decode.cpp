@@ -0,0 +1,303 @@
+/*
+ * decode - turn the byte stream into fixed-size instructions at load time
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "common.h"
+#include "decode.h"
+
+static int count_insns(struct program *prog);
+static int decode_mem(struct program *prog, struct insn *insn,
+                const char **ptr);
+static int resolve_targets(struct program *prog, int *index);
+static int depth_join(int *depth, int *work, int *nwork, int succ, int val);
+
+/*
+ * Every instruction becomes one struct insn; jump operands are turned
+ * from byte offsets into instruction indices and the missing base
+ * register of [imm] into the zero register. An implicit hlt is
+ * appended so that running off the end of the code stops the program.
+ * Returns PROC_OK or an enum proc_status with prog->fault set.
+ */
+int decode_program(struct program *prog)
+{
+        if (!prog) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        prog->uses_ram = 0;
+        int n = count_insns(prog);
+        if (n < 0)
+                return PROC_ERR_INSN;
+        ++n;
+
+        prog->insns = (struct insn *) calloc(n, sizeof(struct insn));
+        prog->offsets = (int *) calloc(n, sizeof(int));
+        int *index = (int *) malloc((prog->size + 1) * sizeof(int));
+        if (!prog->insns || !prog->offsets || !index) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        for (int i = 0; i <= prog->size; ++i)
+                index[i] = -1;
+
+        int pos = 0;
+        for (int i = 0; i < n - 1; ++i) {
+                struct insn *insn = &prog->insns[i];
+                const char *ptr = prog->code + pos;
+
+                insn->op = (unsigned char) *ptr++;
+                if (cmd_has_arg(insn->op)) {
+                        memcpy(&insn->arg, ptr, sizeof(double));
+                        ptr += sizeof(double);
+                }
+                if (cmd_has_reg(insn->op) &&
+                                decode_mem(prog, insn, &ptr) < 0) {
+                        prog->fault = pos;
+                        free(index);
+                        return PROC_ERR_INSN;
+                }
+                if (cmd_is_jmp(insn->op))
+                        memcpy(&insn->target, ptr, sizeof(int));
+
+                prog->offsets[i] = pos;
+                index[pos] = i;
+                pos += cmd_len(insn->op);
+        }
+
+        prog->insns[n - 1].op = CMD_HLT;
+        prog->offsets[n - 1] = pos;
+        index[pos] = n - 1;
+        prog->ninsns = n;
+
+        int status = resolve_targets(prog, index);
+        free(index);
+        return status;
+}
+
+void decode_dtor(struct program *prog)
+{
+        free(prog->lines);
+        prog->lines = NULL;
+        prog->names = NULL;
+        free(prog->depths);
+        prog->depths = NULL;
+        free(prog->insns);
+        prog->insns = NULL;
+        free(prog->offsets);
+        prog->offsets = NULL;
+}
+
+/*
+ * Load the line table after the code if the header has one. Debug info
+ * is optional: a table that doesn't fit the image is ignored, only names
+ * that are terminated inside the image are used.
+ */
+void decode_lines(struct program *prog, const struct header *header)
+{
+        prog->lines = NULL;
+        prog->nlines = 0;
+        prog->names = NULL;
+        if (!(header->reserved & HEADER_DEBUG))
+                return;
+
+        size_t pos = sizeof(struct header) + prog->size;
+        size_t left = prog->image_size - pos;
+        struct debug_header debug = {};
+        if (left < sizeof(debug))
+                return;
+        memcpy(&debug, (const char *) prog->image + pos, sizeof(debug));
+        pos += sizeof(debug);
+        left -= sizeof(debug);
+
+        size_t lines_size = (size_t) debug.nlines * sizeof(struct debug_line);
+        if (lines_size > left || debug.names_size > left - lines_size ||
+                        !debug.names_size)
+                return;
+
+        const char *names = (const char *) prog->image + pos + lines_size;
+        if (names[debug.names_size - 1] != '\0')
+                return;
+
+        /* the table is not aligned in the image, take a copy */
+        prog->lines = (struct debug_line *) malloc(lines_size + 1);
+        if (!prog->lines) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        memcpy(prog->lines, (const char *) prog->image + pos, lines_size);
+        for (uint32_t i = 0; i < debug.nlines; ++i) {
+                if (prog->lines[i].label >= debug.names_size)
+                        prog->lines[i].label = debug_nolabel;
+        }
+        prog->nlines = debug.nlines;
+        prog->names = names;
+}
+
+/* entry of the line holding the code at offset, NULL if there is none */
+const struct debug_line *find_line(const struct program *prog, int offset)
+{
+        int lo = 0, hi = prog->nlines - 1;
+        const struct debug_line *found = NULL;
+        while (lo <= hi) {
+                int mid = lo + (hi - lo) / 2;
+                if (prog->lines[mid].offset <= (uint32_t) offset) {
+                        found = &prog->lines[mid];
+                        lo = mid + 1;
+                } else {
+                        hi = mid - 1;
+                }
+        }
+        return found;
+}
+
+static int count_insns(struct program *prog)
+{
+        int n = 0;
+        for (int pos = 0; pos < prog->size; ++n) {
+                int len = cmd_len((unsigned char) prog->code[pos]);
+                if (len < 0 || pos + len > prog->size) {
+                        prog->fault = pos;
+                        return -1;
+                }
+                pos += len;
+        }
+        return n;
+}
+
+/* register byte and displacement, -1 for an invalid register */
+static int decode_mem(struct program *prog, struct insn *insn,
+                const char **ptr)
+{
+        int reg = (unsigned char) *(*ptr)++;
+        int32_t disp = 0;
+        if (cmd_has_disp(insn->op)) {
+                memcpy(&disp, *ptr, sizeof(int32_t));
+                *ptr += sizeof(int32_t);
+                prog->uses_ram = 1;
+        }
+
+        if (reg == reg_none && cmd_has_disp(insn->op))
+                reg = reg_count;
+        else if (reg >= reg_count)
+                return -1;
+
+        insn->mem.reg = reg;
+        insn->mem.disp = disp;
+        return 0;
+}
+
+static int resolve_targets(struct program *prog, int *index)
+{
+        for (int i = 0; i < prog->ninsns; ++i) {
+                struct insn *insn = &prog->insns[i];
+                if (!cmd_is_jmp(insn->op))
+                        continue;
+
+                int target = insn->target;
+                if (target < 0 || target > prog->size ||
+                                index[target] < 0) {
+                        prog->fault = prog->offsets[i];
+                        return PROC_ERR_TARGET;
+                }
+                insn->target = index[target];
+        }
+        return PROC_OK;
+}
+
+/*
+ * Abstract interpretation of the stack depth over the control flow graph.
+ * Fills depth[] with the depth before every instruction (-1 if it is
+ * unreachable) and returns the maximum depth, or -1 if some instruction
+ * is reached with different depths or would pop an empty stack.
+ */
+int decode_depths(const struct program *prog, int *depth)
+{
+        int n = prog->ninsns;
+        int *work = (int *) malloc(n * sizeof(int));
+        if (!work) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        for (int i = 0; i < n; ++i)
+                depth[i] = -1;
+
+        int nwork = 0;
+        int max_depth = 0;
+        depth[0] = 0;
+        work[nwork++] = 0;
+
+        while (nwork > 0) {
+                int i = work[--nwork];
+                const struct insn *insn = &prog->insns[i];
+                int val = depth[i];
+
+                if (val < cmd_pops(insn->op)) {
+                        free(work);
+                        return -1;
+                }
+                val += cmd_pushes(insn->op) - cmd_pops(insn->op);
+                if (val > max_depth)
+                        max_depth = val;
+
+                if ((cmd_falls_through(insn->op) &&
+                                depth_join(depth, work, &nwork, i + 1, val) < 0) ||
+                                (cmd_is_jmp(insn->op) &&
+                                depth_join(depth, work, &nwork, insn->target,
+                                        val) < 0)) {
+                        free(work);
+                        return -1;
+                }
+        }
+
+        free(work);
+        return max_depth;
+}
+
+static int depth_join(int *depth, int *work, int *nwork, int succ, int val)
+{
+        if (depth[succ] < 0) {
+                depth[succ] = val;
+                work[(*nwork)++] = succ;
+                return 0;
+        }
+        return depth[succ] == val ? 0 : -1;
+}
+
+/*
+ * Load-time verifier, run after a successful decode. Decoding already
+ * guarantees that no instruction runs past header.size and that every
+ * jump lands on an instruction boundary. A program is verified if, in
+ * addition, its stack depth is static, it never pops an empty stack and
+ * out never finds one; it then gets prog->depths and prog->max_depth and
+ * may run on the check-free interpreter. Other programs are still valid
+ * and keep the checked one, so verification never fails a load.
+ */
+void verify_program(struct program *prog)
+{
+        prog->max_depth = -1;
+        int *depth = (int *) malloc(prog->ninsns * sizeof(int));
+        if (!depth) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        int max_depth = decode_depths(prog, depth);
+        for (int i = 0; max_depth >= 0 && i < prog->ninsns; ++i) {
+                int op = prog->insns[i].op;
+                if ((op == CMD_OUT || op == CMD_OUT_HLT) && depth[i] == 0)
+                        max_depth = -1;
+        }
+        if (max_depth < 0) {
+                free(depth);
+                return;
+        }
+
+        prog->depths = depth;
+        prog->max_depth = max_depth;
+}
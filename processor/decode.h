@@ -0,0 +1,13 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "processor.h"
+
+int decode_program(struct program *prog);
+void decode_dtor(struct program *prog);
+int decode_depths(const struct program *prog, int *depth);
+void verify_program(struct program *prog);
+void decode_lines(struct program *prog, const struct header *header);
+const struct debug_line *find_line(const struct program *prog, int offset);
+
+#endif
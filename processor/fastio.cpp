@@ -0,0 +1,430 @@
+/*
+ * fastio - buffered number input and output for in/out
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include "fastio.h"
+
+static int fill(struct fastio_in *in);
+static int is_space(char c);
+static int parse_slow(const char *str, const char *end, double *val);
+static int format_g(char *buf, double val);
+static int format_int(char *buf, uint64_t val);
+static int format_shortest(char *buf, double val);
+static int reads_back(char *buf, int prec, double val);
+
+/* powers of ten that are exact in a double */
+static const double pow10_tab[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+void fastio_in_ctor(struct fastio_in *in, int fd)
+{
+        if (!in) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        in->fd = fd;
+        in->capacity = fastio_bufsize;
+        in->buf = (char *) malloc(in->capacity);
+        if (!in->buf) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        in->pos = 0;
+        in->len = 0;
+        in->eof = 0;
+        in->tie = NULL;
+        in->stop = NULL;
+        in->interrupted = 0;
+}
+
+void fastio_in_dtor(struct fastio_in *in)
+{
+        free(in->buf);
+        in->buf = NULL;
+}
+
+void fastio_out_ctor(struct fastio_out *out, int fd, int shortest)
+{
+        if (!out) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        out->fd = fd;
+        out->buf = (char *) malloc(fastio_bufsize);
+        if (!out->buf) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        out->len = 0;
+        out->shortest = shortest;
+}
+
+void fastio_out_dtor(struct fastio_out *out)
+{
+        fastio_flush(out);
+        free(out->buf);
+        out->buf = NULL;
+}
+
+/* write errors are dropped like printf's in the old in/out */
+void fastio_flush(struct fastio_out *out)
+{
+        size_t done = 0;
+        while (done < out->len) {
+                ssize_t n = write(out->fd, out->buf + done, out->len - done);
+                if (n < 0 && errno == EINTR)
+                        continue;
+                if (n <= 0)
+                        break;
+                done += n;
+        }
+        out->len = 0;
+}
+
+/*
+ * Same contract as scanf("%lg"): 0 at the end of input, and input that
+ * is not a number is left in place, so every later read yields 0 too.
+ * A read that gives up on stop consumes nothing and returns 0, see
+ * fastio_interrupted().
+ */
+double fastio_read(void *ctx)
+{
+        struct fastio_in *in = (struct fastio_in *) ctx;
+        in->interrupted = 0;
+
+        for (;;) {
+                while (in->pos < in->len && is_space(in->buf[in->pos]))
+                        ++in->pos;
+                if (in->pos < in->len)
+                        break;
+                if (in->eof)
+                        return 0;
+                if (!fill(in))
+                        return 0;
+        }
+
+        /* the whole token has to be in the buffer */
+        size_t end = in->pos;
+        for (;;) {
+                while (end < in->len && !is_space(in->buf[end]))
+                        ++end;
+                if (end < in->len || in->eof)
+                        break;
+                end -= in->pos;
+                if (!fill(in))
+                        return 0;
+                end += in->pos;
+        }
+
+        double val = 0;
+        in->pos += fastio_parse(in->buf + in->pos, in->buf + end, &val);
+        return val;
+}
+
+int fastio_interrupted(void *ctx)
+{
+        return ((struct fastio_in *) ctx)->interrupted;
+}
+
+void fastio_write(void *ctx, double val)
+{
+        struct fastio_out *out = (struct fastio_out *) ctx;
+
+        if (out->len + fastio_maxlen > fastio_bufsize)
+                fastio_flush(out);
+        out->len += fastio_format(out->buf + out->len, val, out->shortest);
+        out->buf[out->len++] = '\n';
+}
+
+/*
+ * Move the unread tail to the front and read more after it. The read
+ * may block on a terminal or pipe, so pending output such as a prompt
+ * goes out first. Returns 0 if a signal raised stop while it waited.
+ */
+static int fill(struct fastio_in *in)
+{
+        if (in->tie)
+                fastio_flush(in->tie);
+
+        if (in->pos > 0) {
+                memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+                in->len -= in->pos;
+                in->pos = 0;
+        }
+        if (in->len == in->capacity) {
+                in->capacity *= 2;
+                in->buf = (char *) realloc(in->buf, in->capacity);
+                if (!in->buf) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+        }
+
+        ssize_t n = 0;
+        for (;;) {
+                if (in->stop && *in->stop) {
+                        in->interrupted = 1;
+                        return 0;
+                }
+                n = read(in->fd, in->buf + in->len, in->capacity - in->len);
+                if (n >= 0 || errno != EINTR)
+                        break;
+        }
+
+        if (n <= 0)
+                in->eof = 1;
+        else
+                in->len += n;
+        return 1;
+}
+
+static int is_space(char c)
+{
+        return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * Parse a decimal number from [str, end), returns the number of chars
+ * used (0 if there is no number). Up to 19 significant digits with a
+ * decimal exponent of at most 22 are exact with a single multiplication
+ * or division; everything else (more digits, inf, nan, hex) goes through
+ * strtod.
+ */
+int fastio_parse(const char *str, const char *end, double *val)
+{
+        const char *p = str;
+        int neg = 0;
+        if (p < end && (*p == '-' || *p == '+'))
+                neg = *p++ == '-';
+
+        uint64_t mant = 0;
+        int digits = 0, exp10 = 0, any = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, any = 1) {
+                if (mant || *p != '0')
+                        ++digits;
+                mant = mant * 10 + (*p - '0');
+        }
+        if (p < end && *p == '.') {
+                for (++p; p < end && *p >= '0' && *p <= '9'; ++p, any = 1) {
+                        if (mant || *p != '0')
+                                ++digits;
+                        mant = mant * 10 + (*p - '0');
+                        --exp10;
+                }
+        }
+        if (!any || digits > 19 || (p < end && (*p == 'x' || *p == 'X')))
+                return parse_slow(str, end, val);
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+                const char *q = p + 1;
+                int eneg = 0, exp = 0;
+                if (q < end && (*q == '-' || *q == '+'))
+                        eneg = *q++ == '-';
+                if (q < end && *q >= '0' && *q <= '9') {
+                        for (; q < end && *q >= '0' && *q <= '9'; ++q)
+                                if (exp < 100000)
+                                        exp = exp * 10 + (*q - '0');
+                        exp10 += eneg ? -exp : exp;
+                        p = q;
+                }
+        }
+
+        double res = 0;
+        if (mant == 0)
+                res = 0;
+        else if (mant <= (1ULL << 53) && exp10 >= 0 && exp10 <= 22)
+                res = (double) mant * pow10_tab[exp10];
+        else if (mant <= (1ULL << 53) && exp10 < 0 && exp10 >= -22)
+                res = (double) mant / pow10_tab[-exp10];
+        else
+                return parse_slow(str, end, val);
+
+        *val = neg ? -res : res;
+        return p - str;
+}
+
+static int parse_slow(const char *str, const char *end, double *val)
+{
+        char tmp[512] = "";
+        size_t len = end - str < (long) sizeof(tmp) - 1 ?
+                end - str : sizeof(tmp) - 1;
+        memcpy(tmp, str, len);
+        tmp[len] = '\0';
+
+        char *stop = NULL;
+        double res = strtod(tmp, &stop);
+        if (stop == tmp)
+                return 0;
+        *val = res;
+        return stop - tmp;
+}
+
+/*
+ * Format like "%lg" (or shortest round-trip), returns the length, at
+ * most fastio_maxlen - 1 and without a terminating zero.
+ */
+int fastio_format(char *buf, double val, int shortest)
+{
+        if (isnan(val) || isinf(val))
+                return snprintf(buf, fastio_maxlen, "%lg", val);
+
+        char *p = buf;
+        if (signbit(val)) {
+                *p++ = '-';
+                val = -val;
+        }
+
+        if (val == 0) {
+                *p++ = '0';
+                return p - buf;
+        }
+
+        if (val < (shortest ? 9007199254740992.0 : 1e6) &&
+                        val == (double) (uint64_t) val)
+                return p - buf + format_int(p, (uint64_t) val);
+
+        if (shortest)
+                return p - buf + format_shortest(p, val);
+
+        int len = 0;
+        if (val >= 1e-5 && val < 1e15)
+                len = format_g(p, val);
+        if (!len)
+                len = snprintf(p, fastio_maxlen - 1, "%lg", val);
+        return p - buf + len;
+}
+
+static int format_int(char *buf, uint64_t val)
+{
+        char tmp[20];
+        int n = 0;
+        do {
+                tmp[n++] = '0' + val % 10;
+                val /= 10;
+        } while (val);
+
+        for (int i = 0; i < n; ++i)
+                buf[i] = tmp[n - 1 - i];
+        return n;
+}
+
+/*
+ * %g with 6 significant digits for 1e-5 <= val < 1e15. val is scaled to
+ * [1e5, 1e6) with one rounding, which is far more precise than needed
+ * unless the exact value is within 1e-6 of a rounding tie; those return
+ * 0 and are left to snprintf.
+ */
+static int format_g(char *buf, double val)
+{
+        int e = (int) floor(log10(val));
+        double scaled = 0;
+        for (int tries = 0; tries < 2; ++tries) {
+                scaled = 5 - e >= 0 ? val * pow10_tab[5 - e] :
+                        val / pow10_tab[e - 5];
+                if (scaled < 1e5)
+                        --e;
+                else if (scaled >= 1e6)
+                        ++e;
+                else
+                        break;
+        }
+        if (scaled < 1e5 || scaled >= 1e6)
+                return 0;
+
+        double whole = floor(scaled);
+        double frac = scaled - whole;
+        if (fabs(frac - 0.5) < 1e-6)
+                return 0;
+
+        uint32_t m = (uint32_t) whole + (frac > 0.5);
+        if (m == 1000000) {
+                m = 100000;
+                ++e;
+        }
+
+        char digits[6];
+        for (int i = 5; i >= 0; --i) {
+                digits[i] = '0' + m % 10;
+                m /= 10;
+        }
+        int nd = 6;
+        while (nd > 1 && digits[nd - 1] == '0')
+                --nd;
+
+        char *p = buf;
+        if (e < -4 || e >= 6) {
+                *p++ = digits[0];
+                if (nd > 1) {
+                        *p++ = '.';
+                        for (int i = 1; i < nd; ++i)
+                                *p++ = digits[i];
+                }
+                *p++ = 'e';
+                *p++ = e < 0 ? '-' : '+';
+                int ae = e < 0 ? -e : e;
+                *p++ = '0' + ae / 10;
+                *p++ = '0' + ae % 10;
+        } else if (e >= 0) {
+                for (int i = 0; i <= e; ++i)
+                        *p++ = digits[i];
+                if (nd > e + 1) {
+                        *p++ = '.';
+                        for (int i = e + 1; i < nd; ++i)
+                                *p++ = digits[i];
+                }
+        } else {
+                *p++ = '0';
+                *p++ = '.';
+                for (int i = 0; i < -e - 1; ++i)
+                        *p++ = '0';
+                for (int i = 0; i < nd; ++i)
+                        *p++ = digits[i];
+        }
+        return p - buf;
+}
+
+/*
+ * The fewest significant digits that read back exactly, 17 always do.
+ * The doubles that read back as val lie in an interval around it, and
+ * rounding to one more digit never moves further from val. If the
+ * interval is symmetric and some count reads back, so does every larger
+ * one, which makes it a binary search. A power of two has half the room
+ * below it, so its counts are tried one by one.
+ */
+static int format_shortest(char *buf, double val)
+{
+        uint64_t bits = 0;
+        memcpy(&bits, &val, sizeof(bits));
+
+        int lo = 1, hi = 17;
+        if ((bits & ((1ULL << 52) - 1)) == 0) {
+                while (lo < hi && !reads_back(buf, lo, val))
+                        ++lo;
+                hi = lo;
+        }
+        while (lo < hi) {
+                int prec = (lo + hi) / 2;
+                if (reads_back(buf, prec, val))
+                        hi = prec;
+                else
+                        lo = prec + 1;
+        }
+        return snprintf(buf, fastio_maxlen - 1, "%.*g", lo, val);
+}
+
+static int reads_back(char *buf, int prec, double val)
+{
+        snprintf(buf, fastio_maxlen - 1, "%.*g", prec, val);
+        return strtod(buf, NULL) == val;
+}
@@ -0,0 +1,50 @@
+#ifndef FASTIO_H
+#define FASTIO_H
+
+#include <stddef.h>
+#include <signal.h>
+
+/*
+ * Block-buffered number streams for in/out. A whole buffer is read or
+ * written with one system call and numbers are parsed and formatted by
+ * hand, falling back to strtod/snprintf only for the rare cases the fast
+ * paths can't do exactly. Output is the same as printf("%lg\n").
+ */
+const size_t fastio_bufsize = 1 << 16;
+const int fastio_maxlen = 32;   /* longest formatted number + newline */
+
+struct fastio_out {
+        int fd;
+        char *buf;
+        size_t len;
+        int shortest;           /* shortest round-trip instead of %lg */
+};
+
+struct fastio_in {
+        int fd;
+        char *buf;
+        size_t capacity;
+        size_t pos;
+        size_t len;
+        int eof;
+        struct fastio_out *tie; /* flushed before every read, or NULL */
+        const volatile sig_atomic_t *stop;      /* a blocked read gives up
+                                                   once raised, or NULL */
+        int interrupted;        /* the last fastio_read gave up */
+};
+
+void fastio_in_ctor(struct fastio_in *in, int fd);
+void fastio_in_dtor(struct fastio_in *in);
+void fastio_out_ctor(struct fastio_out *out, int fd, int shortest);
+void fastio_out_dtor(struct fastio_out *out);
+void fastio_flush(struct fastio_out *out);
+
+/* struct proc_io callbacks, ctx is a struct fastio_in/fastio_out */
+double fastio_read(void *in);
+void fastio_write(void *out, double val);
+int fastio_interrupted(void *in);
+
+int fastio_parse(const char *str, const char *end, double *val);
+int fastio_format(char *buf, double val, int shortest);
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * sin/cos for PROC_FAST_MATH: the argument is reduced to [-pi/4, pi/4]
+ * with a three-piece Cody-Waite pi/2 and both functions come from the
+ * fdlibm kernel polynomials. The error against glibc is at most 1 ulp
+ * for |x| <= fast_trig_limit (bench/math_bench measures it); larger,
+ * infinite and NaN arguments go to libm. The kernel has no branches, so
+ * loops over it vectorize.
+ */
+const double fast_trig_limit = 0x1p20;
+
+/* the caller makes sure |x| <= fast_trig_limit */
+static inline void fast_sincos_kernel(double x, double *s, double *c)
+{
+        /* the nearest integer k to x / (pi/2), low bits in the mantissa */
+        double kd = x * 0x1.45f306dc9c883p-1 + 0x1.8p52;
+        uint64_t q = 0;
+        memcpy(&q, &kd, sizeof(q));
+        kd -= 0x1.8p52;
+
+        /* pi/2 in 33-bit pieces: k < 2^20 keeps k * piece exact, and
+           r + rlo carries the reduced argument past double precision */
+        double t = x - kd * 1.57079632673412561417e+00;
+        double p = kd * 6.07710050630396597660e-11;
+        double r = t - p;
+        p = kd * 2.02226624879595063154e-21 - ((t - r) - p);
+        t = r;
+        r = t - p;
+        double rlo = (t - r) - p;
+
+        double z = r * r;
+        double v = z * r;
+        double ps = 8.33333333332248946124e-03 +
+                z * (-1.98412698298579493134e-04 +
+                z * (2.75573137070700676789e-06 +
+                z * (-2.50507602534068634195e-08 +
+                z * 1.58969099521155010221e-10)));
+        double sr = r - ((z * (0.5 * rlo - v * ps) - rlo) -
+                        v * -1.66666666666666324348e-01);
+
+        double pc = z * (4.16666666666666019037e-02 +
+                z * (-1.38888888888741095749e-03 +
+                z * (2.48015872894767294178e-05 +
+                z * (-2.75573143513906633035e-07 +
+                z * (2.08757232129817482790e-09 +
+                z * -1.13596475577881948265e-11)))));
+        double hz = 0.5 * z;
+        double w = 1.0 - hz;
+        double cr = w + (((1.0 - w) - hz) + (z * pc - r * rlo));
+
+        /* quadrant k mod 4: swap for odd k, then the signs */
+        double sv = (q & 1) ? cr : sr;
+        double cv = (q & 1) ? sr : cr;
+        *s = (q & 2) ? -sv : sv;
+        *c = ((q + 1) & 2) ? -cv : cv;
+}
+
+static inline double fast_sin(double x)
+{
+        if (!(fabs(x) <= fast_trig_limit))
+                return sin(x);
+        double s = 0, c = 0;
+        fast_sincos_kernel(x, &s, &c);
+        return s;
+}
+
+static inline double fast_cos(double x)
+{
+        if (!(fabs(x) <= fast_trig_limit))
+                return cos(x);
+        double s = 0, c = 0;
+        fast_sincos_kernel(x, &s, &c);
+        return c;
+}
+
+static inline void fast_sincos(double x, double *s, double *c)
+{
+        if (!(fabs(x) <= fast_trig_limit)) {
+                *s = sin(x);
+                *c = cos(x);
+                return;
+        }
+        fast_sincos_kernel(x, s, c);
+}
+
+/* sqrtsd is exact already, this only skips libm's errno check */
+static inline double fast_sqrt(double x)
+{
+#if defined(__x86_64__) || defined(__i386__)
+        return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+#else
+        return sqrt(x);
+#endif
+}
+
+/* the engines pick libm or the above by enum proc_flags PROC_FAST_MATH */
+static inline double math_sqrt(double x, int fast)
+{
+        return fast ? fast_sqrt(x) : sqrt(x);
+}
+
+static inline double math_sin(double x, int fast)
+{
+        return fast ? fast_sin(x) : sin(x);
+}
+
+static inline double math_cos(double x, int fast)
+{
+        return fast ? fast_cos(x) : cos(x);
+}
+
+static inline void math_sincos(double x, int fast, double *s, double *c)
+{
+        if (fast) {
+                fast_sincos(x, s, c);
+        } else {
+                *s = sin(x);
+                *c = cos(x);
+        }
+}
+
+#endif
@@ -0,0 +1,647 @@
+/*
+ * jit - translate decoded programs into x86-64 machine code
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "processor.h"
+#include "stack.h"
+#include "decode.h"
+#include "jit.h"
+#include "fastmath.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>
+
+/*
+ * Every stack slot gets a fixed home: slot k lives in xmm(k + 2) for the
+ * first jit_nregs slots and in stack memory at [rbx + 8k] above that.
+ * This only works when the stack depth at each instruction is the same
+ * on every path, which decode_depths() checks; programs that fail the check
+ * or underflow the stack are left to the interpreter. xmm0/xmm1 are
+ * scratch, rbx holds the stack base and r12 the processor for helpers.
+ * The int64 instructions add and subtract with paddq/psubq in place and
+ * move the operands of the others through rax and rcx.
+ */
+const int jit_nregs = 14;
+const int jit_mem = 16;         /* operand locations >= jit_mem are memory */
+
+typedef int (*jit_fn)(double *stack, struct processor *processor);
+
+struct jit_buf {
+        unsigned char *data;
+        size_t size;
+        size_t capacity;
+};
+
+struct jit_fixup {
+        size_t pos;             /* offset of the rel32 field */
+        int target;             /* insn index, -1 for the epilogue */
+};
+
+struct jit {
+        struct jit_buf buf;
+        struct jit_fixup *fixups;
+        int nfixups;
+        size_t *pos;            /* code offset of every insn */
+        int *depth;             /* stack depth before every insn, -1 dead */
+        int max_depth;
+        int fast;               /* call the fastmath.h sin/cos */
+};
+
+static int jit_compile(struct processor *processor, struct jit *jit);
+static void jit_insn(struct jit *jit, const struct insn *insn, int depth);
+static void jit_dtor(struct jit *jit);
+
+static void emit(struct jit_buf *buf, const void *bytes, size_t n);
+static void emit_byte(struct jit_buf *buf, unsigned char byte);
+static void emit_u32(struct jit_buf *buf, uint32_t val);
+static void emit_sse(struct jit_buf *buf, unsigned char prefix,
+                unsigned char opcode, int reg, int loc);
+static void emit_load(struct jit_buf *buf, int reg, int loc);
+static void emit_store(struct jit_buf *buf, int loc, int reg);
+static void emit_const(struct jit_buf *buf, int loc, double val);
+static void emit_arith(struct jit_buf *buf, unsigned char opcode,
+                int dst, int src);
+static void emit_spill(struct jit_buf *buf, int depth);
+static void emit_reload(struct jit_buf *buf, int depth);
+static void emit_gpr_load(struct jit_buf *buf, int gpr, int loc);
+static void emit_gpr_store(struct jit_buf *buf, int loc, int gpr);
+static void emit_packed(struct jit_buf *buf, unsigned char opcode,
+                int dst, int src);
+static void emit_int_arith(struct jit_buf *buf, const unsigned char *op,
+                size_t n, int dst, int src);
+static void emit_call(struct jit_buf *buf, const void *fn);
+static void emit_jmp(struct jit *jit, unsigned char cc, int target);
+
+static double jit_in(struct processor *processor);
+static void jit_out(struct processor *processor, double val);
+static double jit_idiv(double b, double a);
+
+static int slot_loc(int slot)
+{
+        return slot < jit_nregs ? slot + 2 : jit_mem + slot;
+}
+
+int jit_run(struct processor *processor, int flags)
+{
+        if (!processor || !processor->prog || !processor->prog->insns) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        struct jit jit = {};
+        jit.fast = (flags & PROC_FAST_MATH) != 0;
+        jit.depth = (int *) malloc(processor->prog->ninsns * sizeof(int));
+        if (!jit.depth) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        jit.max_depth = decode_depths(processor->prog, jit.depth);
+        if (jit.max_depth < 0 || jit_compile(processor, &jit) < 0) {
+                jit_dtor(&jit);
+                return -1;
+        }
+
+        void *mem = mmap(NULL, jit.buf.size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+                jit_dtor(&jit);
+                return -1;
+        }
+        memcpy(mem, jit.buf.data, jit.buf.size);
+        if (mprotect(mem, jit.buf.size, PROT_READ | PROT_EXEC) < 0) {
+                munmap(mem, jit.buf.size);
+                jit_dtor(&jit);
+                return -1;
+        }
+
+        struct dstack *stk = &processor->stk;
+        int need = jit.max_depth > jit_nregs ? jit.max_depth : jit_nregs;
+        while (stk->capacity < need)
+                dstack_grow(stk);
+
+        jit_fn fn = (jit_fn) mem;
+        stk->size = fn(stk->data, processor);
+
+        munmap(mem, jit.buf.size);
+        jit_dtor(&jit);
+        return 0;
+}
+
+static int jit_compile(struct processor *processor, struct jit *jit)
+{
+        int n = processor->prog->ninsns;
+        /* registers and RAM are left to the interpreter */
+        for (int i = 0; i < n; ++i)
+                if (cmd_has_reg(processor->prog->insns[i].op))
+                        return -1;
+
+        jit->pos = (size_t *) calloc(n, sizeof(size_t));
+        jit->fixups = (struct jit_fixup *) calloc(2 * n + 1,
+                        sizeof(struct jit_fixup));
+        if (!jit->pos || !jit->fixups) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        struct jit_buf *buf = &jit->buf;
+
+        /* push rbx; push r12; sub rsp, 8; mov rbx, rdi; mov r12, rsi */
+        const unsigned char prologue[] = {0x53, 0x41, 0x54, 0x48, 0x83, 0xec,
+                0x08, 0x48, 0x89, 0xfb, 0x49, 0x89, 0xf4};
+        emit(buf, prologue, sizeof(prologue));
+
+        for (int i = 0; i < n; ++i) {
+                jit->pos[i] = buf->size;
+                if (jit->depth[i] >= 0)
+                        jit_insn(jit, &processor->prog->insns[i],
+                                        jit->depth[i]);
+        }
+
+        /* spill every register slot, the caller reads the stack memory */
+        size_t epilogue = buf->size;
+        for (int k = 0; k < jit_nregs; ++k)
+                emit_store(buf, jit_mem + k, slot_loc(k));
+
+        /* add rsp, 8; pop r12; pop rbx; ret */
+        const unsigned char ret[] = {0x48, 0x83, 0xc4, 0x08, 0x41, 0x5c,
+                0x5b, 0xc3};
+        emit(buf, ret, sizeof(ret));
+
+        for (int i = 0; i < jit->nfixups; ++i) {
+                struct jit_fixup *fixup = &jit->fixups[i];
+                size_t to = fixup->target < 0 ? epilogue :
+                        jit->pos[fixup->target];
+                int32_t rel = (int32_t) (to - (fixup->pos + 4));
+                memcpy(buf->data + fixup->pos, &rel, sizeof(int32_t));
+        }
+
+        return 0;
+}
+
+/* SSE opcodes, all F2-prefixed scalar double except ucomisd and the
+   packed integer ones (66) */
+enum {
+        SSE_LOAD = 0x10,
+        SSE_STORE = 0x11,
+        SSE_SQRT = 0x51,
+        SSE_ADD = 0x58,
+        SSE_MUL = 0x59,
+        SSE_SUB = 0x5c,
+        SSE_DIV = 0x5e,
+        SSE_UCOMI = 0x2e,
+        SSE_PADDQ = 0xd4,
+        SSE_PSUBQ = 0xfb,
+};
+
+/* condition codes for jcc rel32 (0x0f 0x80 + cc) */
+enum {
+        CC_ALWAYS = 0xff,
+        CC_AE = 0x3,
+        CC_E = 0x4,
+        CC_NE = 0x5,
+        CC_A = 0x7,
+        CC_P = 0xa,
+        CC_L = 0xc,
+        CC_GE = 0xd,
+        CC_LE = 0xe,
+        CC_G = 0xf,
+};
+
+/* imul rax, rcx */
+static const unsigned char op_imul[] = {0x48, 0x0f, 0xaf, 0xc1};
+
+static void jit_insn(struct jit *jit, const struct insn *insn, int depth)
+{
+        struct jit_buf *buf = &jit->buf;
+        int top = slot_loc(depth - 1);
+        int second = slot_loc(depth - 2);
+        const void *sin_fn = jit->fast ?
+                (const void *) (double (*)(double)) fast_sin :
+                (const void *) (double (*)(double)) sin;
+        const void *cos_fn = jit->fast ?
+                (const void *) (double (*)(double)) fast_cos :
+                (const void *) (double (*)(double)) cos;
+
+        switch (insn->op) {
+                case CMD_HLT:
+                        emit_byte(buf, 0xb8);           /* mov eax, depth */
+                        emit_u32(buf, depth);
+                        emit_jmp(jit, CC_ALWAYS, -1);
+                        break;
+                case CMD_PUSH:
+                        emit_const(buf, slot_loc(depth), insn->arg);
+                        break;
+                case CMD_ADD:
+                        emit_arith(buf, SSE_ADD, second, top);
+                        break;
+                case CMD_SUB:
+                        emit_arith(buf, SSE_SUB, second, top);
+                        break;
+                case CMD_MUL:
+                        emit_arith(buf, SSE_MUL, second, top);
+                        break;
+                case CMD_DIV:
+                        emit_arith(buf, SSE_DIV, second, top);
+                        break;
+                case CMD_SQRT:
+                        emit_arith(buf, SSE_SQRT, top, top);
+                        break;
+                case CMD_SIN:
+                case CMD_COS:
+                        emit_spill(buf, depth);
+                        emit_load(buf, 0, jit_mem + depth - 1);
+                        emit_call(buf, insn->op == CMD_SIN ? sin_fn : cos_fn);
+                        emit_store(buf, jit_mem + depth - 1, 0);
+                        emit_reload(buf, depth);
+                        break;
+                case CMD_SINCOS:
+                        /* cos goes on top, then sin replaces x */
+                        emit_spill(buf, depth);
+                        emit_load(buf, 0, jit_mem + depth - 1);
+                        emit_call(buf, cos_fn);
+                        emit_store(buf, jit_mem + depth, 0);
+                        emit_load(buf, 0, jit_mem + depth - 1);
+                        emit_call(buf, sin_fn);
+                        emit_store(buf, jit_mem + depth - 1, 0);
+                        emit_reload(buf, depth + 1);
+                        break;
+                case CMD_IN:
+                        emit_spill(buf, depth);
+                        emit_call(buf, (const void *) jit_in);
+                        emit_store(buf, jit_mem + depth, 0);
+                        emit_reload(buf, depth + 1);
+                        break;
+                case CMD_OUT:
+                case CMD_OUT_HLT:
+                        if (depth > 0) {
+                                emit_spill(buf, depth);
+                                emit_load(buf, 0, jit_mem + depth - 1);
+                                emit_call(buf, (const void *) jit_out);
+                                emit_reload(buf, depth);
+                        }
+                        if (insn->op == CMD_OUT_HLT) {
+                                emit_byte(buf, 0xb8);
+                                emit_u32(buf, depth);
+                                emit_jmp(jit, CC_ALWAYS, -1);
+                        }
+                        break;
+                case CMD_JMP:
+                        emit_jmp(jit, CC_ALWAYS, insn->target);
+                        break;
+                case CMD_JA:
+                case CMD_JAE:
+                case CMD_JE:
+                case CMD_JNE:
+                        emit_load(buf, 0, second);
+                        emit_sse(buf, 0x66, SSE_UCOMI, 0, top);
+                        if (insn->op == CMD_JA) {
+                                emit_jmp(jit, CC_A, insn->target);
+                        } else if (insn->op == CMD_JAE) {
+                                emit_jmp(jit, CC_AE, insn->target);
+                        } else if (insn->op == CMD_JE) {
+                                /* unordered sets ZF too: skip the je on PF */
+                                const unsigned char jp[] = {0x7a, 0x06};
+                                emit(buf, jp, sizeof(jp));
+                                emit_jmp(jit, CC_E, insn->target);
+                        } else {
+                                emit_jmp(jit, CC_NE, insn->target);
+                                emit_jmp(jit, CC_P, insn->target);
+                        }
+                        break;
+                case CMD_JB:
+                case CMD_JBE:
+                        /* b < a is a > b, which also fails on NaN */
+                        emit_load(buf, 0, top);
+                        emit_sse(buf, 0x66, SSE_UCOMI, 0, second);
+                        emit_jmp(jit, insn->op == CMD_JB ? CC_A : CC_AE,
+                                        insn->target);
+                        break;
+                case CMD_PUSH_ADD:
+                case CMD_PUSH_MUL:
+                        emit_const(buf, 1, insn->arg);
+                        emit_arith(buf, insn->op == CMD_PUSH_ADD ? SSE_ADD :
+                                        SSE_MUL, top, 1);
+                        break;
+                case CMD_PUSH_JB:
+                        emit_const(buf, 0, insn->arg);
+                        emit_sse(buf, 0x66, SSE_UCOMI, 0, top);
+                        emit_jmp(jit, CC_A, insn->target);
+                        break;
+                case CMD_IPUSH:
+                        emit_const(buf, slot_loc(depth), insn->arg);
+                        break;
+                case CMD_IADD:
+                        emit_packed(buf, SSE_PADDQ, second, top);
+                        break;
+                case CMD_ISUB:
+                        emit_packed(buf, SSE_PSUBQ, second, top);
+                        break;
+                case CMD_IMUL:
+                        emit_int_arith(buf, op_imul, sizeof(op_imul), second,
+                                        top);
+                        break;
+                case CMD_IPUSH_ADD:
+                        emit_const(buf, 1, insn->arg);
+                        emit_packed(buf, SSE_PADDQ, top, 1);
+                        break;
+                case CMD_IDIV:
+                        /* int_div() does not trap, idiv would */
+                        emit_spill(buf, depth);
+                        emit_load(buf, 0, jit_mem + depth - 2);
+                        emit_load(buf, 1, jit_mem + depth - 1);
+                        emit_call(buf, (const void *) jit_idiv);
+                        emit_store(buf, jit_mem + depth - 2, 0);
+                        emit_reload(buf, depth - 1);
+                        break;
+                case CMD_IJA:
+                case CMD_IJAE:
+                case CMD_IJB:
+                case CMD_IJBE:
+                case CMD_IJE:
+                case CMD_IJNE: {
+                        static const unsigned char cc[] = {CC_G, CC_GE, CC_L,
+                                CC_LE, CC_E, CC_NE};
+                        const unsigned char cmp[] = {0x48, 0x39, 0xc8};
+                        emit_gpr_load(buf, 0, second);
+                        emit_gpr_load(buf, 1, top);
+                        emit(buf, cmp, sizeof(cmp));    /* cmp rax, rcx */
+                        emit_jmp(jit, cc[insn->op - CMD_IJA], insn->target);
+                        break;
+                }
+                case CMD_ITOF: {
+                        /* cvtsi2sd xmm0, rax */
+                        const unsigned char cvt[] = {0xf2, 0x48, 0x0f, 0x2a,
+                                0xc0};
+                        emit_gpr_load(buf, 0, top);
+                        emit(buf, cvt, sizeof(cvt));
+                        emit_store(buf, top, 0);
+                        break;
+                }
+                case CMD_FTOI: {
+                        /* cvttsd2si rax, xmm0 gives INT64_MIN out of range,
+                           as int_from_double() */
+                        const unsigned char cvt[] = {0xf2, 0x48, 0x0f, 0x2c,
+                                0xc0};
+                        emit_load(buf, 0, top);
+                        emit(buf, cvt, sizeof(cvt));
+                        emit_gpr_store(buf, top, 0);
+                        break;
+                }
+        }
+}
+
+static void jit_dtor(struct jit *jit)
+{
+        free(jit->buf.data);
+        free(jit->fixups);
+        free(jit->pos);
+        free(jit->depth);
+}
+
+static void emit(struct jit_buf *buf, const void *bytes, size_t n)
+{
+        if (buf->size + n > buf->capacity) {
+                size_t capacity = buf->capacity ? buf->capacity * 2 : 4096;
+                while (capacity < buf->size + n)
+                        capacity *= 2;
+
+                buf->data = (unsigned char *) realloc(buf->data, capacity);
+                if (!buf->data) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+                buf->capacity = capacity;
+        }
+
+        memcpy(buf->data + buf->size, bytes, n);
+        buf->size += n;
+}
+
+static void emit_byte(struct jit_buf *buf, unsigned char byte)
+{
+        emit(buf, &byte, sizeof(byte));
+}
+
+static void emit_u32(struct jit_buf *buf, uint32_t val)
+{
+        emit(buf, &val, sizeof(val));
+}
+
+/* prefix [rex] 0f opcode modrm, with loc either xmm0-15 or [rbx + disp32] */
+static void emit_sse(struct jit_buf *buf, unsigned char prefix,
+                unsigned char opcode, int reg, int loc)
+{
+        emit_byte(buf, prefix);
+
+        unsigned char rex = 0x40;
+        if (reg >= 8)
+                rex |= 0x04;
+        if (loc < jit_mem && loc >= 8)
+                rex |= 0x01;
+        if (rex != 0x40)
+                emit_byte(buf, rex);
+
+        emit_byte(buf, 0x0f);
+        emit_byte(buf, opcode);
+
+        if (loc < jit_mem) {
+                emit_byte(buf, 0xc0 | (reg & 7) << 3 | (loc & 7));
+        } else {
+                emit_byte(buf, 0x80 | (reg & 7) << 3 | 0x3);
+                emit_u32(buf, (loc - jit_mem) * sizeof(double));
+        }
+}
+
+static void emit_load(struct jit_buf *buf, int reg, int loc)
+{
+        if (loc == reg)
+                return;
+        if (loc < jit_mem)
+                emit_sse(buf, 0x66, 0x28, reg, loc);    /* movapd */
+        else
+                emit_sse(buf, 0xf2, SSE_LOAD, reg, loc);
+}
+
+static void emit_store(struct jit_buf *buf, int loc, int reg)
+{
+        if (loc < jit_mem)
+                emit_load(buf, loc, reg);
+        else
+                emit_sse(buf, 0xf2, SSE_STORE, reg, loc);
+}
+
+static void emit_const(struct jit_buf *buf, int loc, double val)
+{
+        uint64_t bits = 0;
+        memcpy(&bits, &val, sizeof(bits));
+
+        emit_byte(buf, 0x48);                   /* mov rax, imm64 */
+        emit_byte(buf, 0xb8);
+        emit(buf, &bits, sizeof(bits));
+
+        if (loc < jit_mem) {                    /* movq xmm, rax */
+                emit_byte(buf, 0x66);
+                emit_byte(buf, loc >= 8 ? 0x4c : 0x48);
+                emit_byte(buf, 0x0f);
+                emit_byte(buf, 0x6e);
+                emit_byte(buf, 0xc0 | (loc & 7) << 3);
+        } else {                                /* mov [rbx + disp], rax */
+                emit_byte(buf, 0x48);
+                emit_byte(buf, 0x89);
+                emit_byte(buf, 0x83);
+                emit_u32(buf, (loc - jit_mem) * sizeof(double));
+        }
+}
+
+static void emit_arith(struct jit_buf *buf, unsigned char opcode,
+                int dst, int src)
+{
+        if (dst < jit_mem) {
+                emit_sse(buf, 0xf2, opcode, dst, src);
+                return;
+        }
+        emit_load(buf, 0, dst);
+        emit_sse(buf, 0xf2, opcode, 0, src);
+        emit_store(buf, dst, 0);
+}
+
+/* gpr is rax or rcx, the 64 bits of loc are moved unchanged */
+static void emit_gpr_load(struct jit_buf *buf, int gpr, int loc)
+{
+        if (loc < jit_mem) {                    /* movq gpr, xmm */
+                emit_byte(buf, 0x66);
+                emit_byte(buf, loc >= 8 ? 0x4c : 0x48);
+                emit_byte(buf, 0x0f);
+                emit_byte(buf, 0x7e);
+                emit_byte(buf, 0xc0 | (loc & 7) << 3 | gpr);
+        } else {                                /* mov gpr, [rbx + disp] */
+                emit_byte(buf, 0x48);
+                emit_byte(buf, 0x8b);
+                emit_byte(buf, 0x83 | gpr << 3);
+                emit_u32(buf, (loc - jit_mem) * sizeof(double));
+        }
+}
+
+static void emit_gpr_store(struct jit_buf *buf, int loc, int gpr)
+{
+        if (loc < jit_mem) {                    /* movq xmm, gpr */
+                emit_byte(buf, 0x66);
+                emit_byte(buf, loc >= 8 ? 0x4c : 0x48);
+                emit_byte(buf, 0x0f);
+                emit_byte(buf, 0x6e);
+                emit_byte(buf, 0xc0 | (loc & 7) << 3 | gpr);
+        } else {                                /* mov [rbx + disp], gpr */
+                emit_byte(buf, 0x48);
+                emit_byte(buf, 0x89);
+                emit_byte(buf, 0x83 | gpr << 3);
+                emit_u32(buf, (loc - jit_mem) * sizeof(double));
+        }
+}
+
+/*
+ * dst = dst OP src on the low quadwords. The memory form of a packed
+ * instruction reads 16 aligned bytes, so memory sources go through xmm1.
+ */
+static void emit_packed(struct jit_buf *buf, unsigned char opcode,
+                int dst, int src)
+{
+        if (src >= jit_mem) {
+                emit_load(buf, 1, src);
+                src = 1;
+        }
+        if (dst < jit_mem) {
+                emit_sse(buf, 0x66, opcode, dst, src);
+                return;
+        }
+        emit_load(buf, 0, dst);
+        emit_sse(buf, 0x66, opcode, 0, src);
+        emit_store(buf, dst, 0);
+}
+
+/* dst = dst OP src through rax and rcx, op is an instruction on them */
+static void emit_int_arith(struct jit_buf *buf, const unsigned char *op,
+                size_t n, int dst, int src)
+{
+        emit_gpr_load(buf, 0, dst);
+        emit_gpr_load(buf, 1, src);
+        emit(buf, op, n);
+        emit_gpr_store(buf, dst, 0);
+}
+
+/* calls clobber every xmm register, so live register slots go to memory */
+static void emit_spill(struct jit_buf *buf, int depth)
+{
+        for (int k = 0; k < depth && k < jit_nregs; ++k)
+                emit_store(buf, jit_mem + k, slot_loc(k));
+}
+
+static void emit_reload(struct jit_buf *buf, int depth)
+{
+        for (int k = 0; k < depth && k < jit_nregs; ++k)
+                emit_load(buf, slot_loc(k), jit_mem + k);
+}
+
+/*
+ * call fn with the processor in rdi, double arguments stay in xmm0 and
+ * xmm1. Functions of doubles only, like sin or jit_idiv, ignore rdi.
+ */
+static void emit_call(struct jit_buf *buf, const void *fn)
+{
+        uint64_t addr = (uint64_t) fn;
+        const unsigned char mov_rdi[] = {0x4c, 0x89, 0xe7};
+
+        emit(buf, mov_rdi, sizeof(mov_rdi));
+        emit_byte(buf, 0x48);                   /* mov rax, imm64 */
+        emit_byte(buf, 0xb8);
+        emit(buf, &addr, sizeof(addr));
+        emit_byte(buf, 0xff);                   /* call rax */
+        emit_byte(buf, 0xd0);
+}
+
+static void emit_jmp(struct jit *jit, unsigned char cc, int target)
+{
+        struct jit_buf *buf = &jit->buf;
+
+        if (cc == CC_ALWAYS) {
+                emit_byte(buf, 0xe9);
+        } else {
+                emit_byte(buf, 0x0f);
+                emit_byte(buf, 0x80 | cc);
+        }
+
+        jit->fixups[jit->nfixups].pos = buf->size;
+        jit->fixups[jit->nfixups].target = target;
+        ++jit->nfixups;
+        emit_u32(buf, 0);
+}
+
+static double jit_in(struct processor *processor)
+{
+        return processor->io.in(processor->io.in_ctx);
+}
+
+static void jit_out(struct processor *processor, double val)
+{
+        processor->io.out(processor->io.out_ctx, val);
+}
+
+static double jit_idiv(double b, double a)
+{
+        return slot_idiv(b, a);
+}
+
+#else
+
+int jit_run(struct processor *processor, int flags)
+{
+        return -1;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "processor.h"
+
+/* compile and run the program, -1 if it has to be interpreted instead;
+ * flags are enum proc_flags, PROC_FAST_MATH picks the sin/cos it calls */
+int jit_run(struct processor *processor, int flags);
+
+#endif
@@ -1,14 +1,82 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "processor.h"
 
+static int math_flags(const char *mode);
+
 int main(int argc, char *argv[])
 {
-        if (argc != 2) {
+        struct proc_opts opts = {};
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "bc:gjl:m:n:p:rs:t:")) != -1) {
+                switch (opt) {
+                        case 'b':
+                                opts.flags |= PROC_BATCH;
+                                break;
+                        case 'c':
+                                opts.checkpoint = optarg;
+                                break;
+                        case 'g':
+                                opts.flags |= PROC_REG;
+                                break;
+                        case 'j':
+                                opts.flags |= PROC_JIT;
+                                break;
+                        case 'l':
+                                opts.resume = optarg;
+                                break;
+                        case 'm':
+                                opts.flags |= math_flags(optarg);
+                                break;
+                        case 'n':
+                                opts.checkpoint_every = atol(optarg);
+                                break;
+                        case 'p':
+                                opts.profile = optarg;
+                                break;
+                        case 'r':
+                                opts.flags |= PROC_SHORTEST;
+                                break;
+                        case 's':
+                                opts.samples = optarg;
+                                break;
+                        case 't':
+                                opts.trace = optarg;
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-b] [-g] [-j] [-r] "
+                                                "[-p report] [-s samples] "
+                                                "[-m strict|fast|batched] "
+                                                "[-t trace] "
+                                                "[-c checkpoint [-n insns]] "
+                                                "[-l checkpoint] binary\n",
+                                                argv[0]);
+                                exit(1);
+                }
+        }
+
+        if (optind != argc - 1) {
                 fprintf(stderr, "error: binary file not specified\n");
                 exit(1);
         }
 
-        run_processor(argv[1]);
+        run_processor(argv[optind], &opts);
         return 0;
 }
+
+/* batched is fast math over the lanes of batch mode, see fastmath.h */
+static int math_flags(const char *mode)
+{
+        if (strcmp(mode, "strict") == 0)
+                return 0;
+        if (strcmp(mode, "fast") == 0)
+                return PROC_FAST_MATH;
+        if (strcmp(mode, "batched") == 0)
+                return PROC_FAST_MATH | PROC_BATCH;
+
+        fprintf(stderr, "error: unknown math mode %s\n", mode);
+        exit(1);
+}
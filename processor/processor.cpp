@@ -6,393 +6,902 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 #include "processor.h"
 #include "stack.h"
+#include "decode.h"
+#include "jit.h"
+#include "regvm.h"
+#include "batch.h"
+#include "profile.h"
+#include "fastio.h"
+#include "checkpoint.h"
+#include "sample.h"
+#include "trace.h"
+#include "fastmath.h"
+
+static int read_image(struct program *prog);
+static int verify_signature(struct header *header);
+template <int verified>
+static int execute_program(struct processor *processor, int flags);
+static int run_checkpointed(struct processor *processor,
+                const struct proc_opts *opts, struct fastio_out *out);
+static void write_profile(struct processor *processor, const char *filename);
+static void write_samples(struct processor *processor, const char *filename);
 
-static FILE *open_bin(const char *filename);
-static void read_bin(FILE *bin, struct processor *processor);
-static void verify_signature(FILE *bin);
-static void execute_program(struct processor *processor);
-static int execute_cmd(struct processor *processor, int opcode);
-
-static void execute_cmd_push(struct processor *processor);
-static void execute_cmd_add(struct processor *processor);
-static void execute_cmd_sub(struct processor *processor);
-static void execute_cmd_mul(struct processor *processor);
-static void execute_cmd_div(struct processor *processor);
-static void execute_cmd_out(struct processor *processor);
-static void execute_cmd_in(struct processor *processor);
-static void execute_cmd_sqrt(struct processor *processor);
-static void execute_cmd_sin(struct processor *processor);
-static void execute_cmd_cos(struct processor *processor);
-
-static void execute_cmd_jmp(struct processor *processor);
-static void execute_cmd_ja(struct processor *processor);
-static void execute_cmd_jae(struct processor *processor);
-static void execute_cmd_jb(struct processor *processor);
-static void execute_cmd_jbe(struct processor *processor);
-static void execute_cmd_je(struct processor *processor);
-static void execute_cmd_jne(struct processor *processor);
-
-#ifdef DEBUG
-static void processor_dump(struct processor *processor);
+/*
+ * The interpreter loop is written once in terms of OP()/NEXT and compiled
+ * either as direct-threaded code (computed goto, the default on GNU
+ * compilers) or as a plain switch when built with -D DISPATCH_SWITCH.
+ */
+#if !defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+#define DISPATCH_SWITCH
 #endif
 
-#define BIN_ARITHMETIC(OP) double a = 0, b = 0, c = 0;      \
-                           ++processor->ip;                 \
-                           stack_pop(&processor->stk, &a);  \
-                           stack_pop(&processor->stk, &b);  \
-                           c = b OP a;                      \
-                           stack_push(&processor->stk, &c);
-
-#define UNARY_ARITHMETIC(OP) double a = 0, b = 0;            \
-                             ++processor->ip;                \
-                             stack_pop(&processor->stk, &a); \
-                             b = OP(a);                      \
-                             stack_push(&processor->stk, &b);
-
-#define CONDITIONAL_JMP(OP) int arg = 0;                                  \
-                            double a = 0, b = 0;                          \
-                            ++processor->ip;                              \
-                            memcpy(&arg, processor->code + processor->ip, \
-                                            sizeof(int));                 \
-                            stack_pop(&processor->stk, &a);               \
-                            stack_pop(&processor->stk, &b);               \
-                            if (b OP a)                                   \
-                                    processor->ip = arg;
-
-void run_processor(const char *filename)
-{
-        struct processor processor = {};
-        stack_ctor(&processor.stk, 10, sizeof(double));
+/*
+ * Instrumentation (the profiler, the trace, the instruction budget) runs
+ * through HOOK() before every instruction. The threaded engine swaps in a
+ * dispatch table whose entries all lead to the hook, so the
+ * uninstrumented path pays nothing.
+ */
+#define HOOK() do {                                                     \
+                       if (processor->budget >= 0 &&                    \
+                                       processor->budget-- == 0)        \
+                               goto out_of_budget;                      \
+                       if (processor->trace)                            \
+                               trace_step(processor->trace,             \
+                                       processor->prog->offsets[pc - code], \
+                                       pc->op, sp - base, tos);         \
+                       if (processor->prof)                             \
+                               profile_step(processor->prof, pc - code, \
+                                            sp - base);                 \
+                       if (sampler)                                     \
+                               sampler_take(sampler, pc - code);        \
+               } while (0)
 
-        FILE *bin = open_bin(filename);
-        read_bin(bin, &processor);
-        fclose(bin);
+/*
+ * Taken jumps are safepoints: every loop passes one, so a raised
+ * processor->stop is seen soon, and straight-line code pays nothing.
+ */
+#define SAFEPOINT() if (processor->stop)                                \
+                            goto stopped;
+
+#ifdef DISPATCH_SWITCH
+#define ENGINE_BEGIN() for (;;) {                            \
+                               if (hooked)                   \
+                                       HOOK();               \
+                               switch (pc->op) {
+#define ENGINE_END()           default:                      \
+                                       goto invalid;         \
+                               }                             \
+                       }
+#define OP(CMD) case CMD:
+#define NEXT() continue
+#else
+#define ENGINE_BEGIN() NEXT();
+#define ENGINE_END()
+#define OP(CMD) op_##CMD:
+#define NEXT() goto *table[pc->op]
+#define TARGET(CMD) dispatch[CMD] = &&op_##CMD
+#endif
 
-        execute_program(&processor);
-}
+/*
+ * The engine is instantiated twice. execute_program<0> checks the stack
+ * on every instruction. execute_program<1> is only entered for programs
+ * that passed verify_program() with the stack at the verified depth and
+ * at least max_depth slots, so overflow and underflow cannot happen and
+ * the checks below fold away.
+ *
+ * The top of the operand stack lives in the local tos and the rest in
+ * stk->data[0 .. sp - base - 1], so arithmetic on a stack at least two
+ * deep touches memory only for the second operand. SPILL() writes the
+ * cached value back to struct dstack and FILL() reloads the locals; they
+ * bracket everything that needs the real stack (growth, I/O, underflow).
+ * dstack keeps a guard slot below data[0], so spilling or reloading tos
+ * on an empty stack is harmless.
+ */
+#define SPILL() stk->size = sp - base;                   \
+                sp[-1] = tos;
+
+#define FILL() base = stk->data;                         \
+               sp = base + stk->size;                    \
+               limit = base + stk->capacity;             \
+               tos = sp[-1];
+
+#define PUSH(VAL) if (!verified && sp >= limit) {                     \
+                          SPILL();                       \
+                          dstack_grow(stk);              \
+                          FILL();                        \
+                  }                                      \
+                  sp[-1] = tos;                          \
+                  tos = VAL;                             \
+                  ++sp;
+
+#define BIN_ARITHMETIC(OP) ++pc;                                        \
+                           if (verified || sp - base >= 2) {                        \
+                                   tos = sp[-2] OP tos;                 \
+                                   --sp;                                \
+                           } else {                                     \
+                                   SPILL();                             \
+                                   double a = dstack_pop(stk);          \
+                                   double b = dstack_pop(stk);          \
+                                   dstack_push(stk, b OP a);            \
+                                   FILL();                              \
+                           }
+
+/* OP is one of the fastmath.h math_ functions */
+#define UNARY_ARITHMETIC(OP) ++pc;                                      \
+                             if (verified || sp != base) {              \
+                                     tos = OP(tos, fast);               \
+                             } else {                                   \
+                                     double a = OP(0.0, fast);          \
+                                     PUSH(a);                           \
+                             }
+
+/* push <arg>; OP fused: the immediate is the right-hand operand */
+#define IMM_ARITHMETIC(OP) if (verified || sp != base) {                \
+                                   tos = tos OP pc->arg;                \
+                           } else {                                     \
+                                   double a = 0.0 OP pc->arg;           \
+                                   PUSH(a);                             \
+                           }                                            \
+                           ++pc;
+
+/* FN is one of the stack.h slot_ functions for the int64 instructions */
+#define INT_ARITHMETIC(FN) ++pc;                                        \
+                           if (verified || sp - base >= 2) {            \
+                                   tos = FN(sp[-2], tos);               \
+                                   --sp;                                \
+                           } else {                                     \
+                                   SPILL();                             \
+                                   double a = dstack_pop(stk);          \
+                                   double b = dstack_pop(stk);          \
+                                   dstack_push(stk, FN(b, a));          \
+                                   FILL();                              \
+                           }
 
-static FILE *open_bin(const char *filename)
+/*
+ * addr of push/pop [reg+imm], faults before anything changes. [imm] has
+ * the zero register regs[reg_count] as its base.
+ */
+#define RAM_ADDRESS() uint64_t addr = pc->mem.disp + (uint64_t)         \
+                      int_from_double(processor->regs[pc->mem.reg]);    \
+                      if (addr >= (uint64_t) ram_size)                  \
+                              goto bad_address;
+
+/* COND on a, the popped top, and b below it */
+#define COMPARE_JMP(COND)   double a = 0, b = 0;                          \
+                            if (verified || sp - base >= 2) {             \
+                                    a = tos;                              \
+                                    b = sp[-2];                           \
+                                    sp -= 2;                              \
+                                    tos = sp[-1];                         \
+                            } else {                                      \
+                                    SPILL();                              \
+                                    a = dstack_pop(stk);                  \
+                                    b = dstack_pop(stk);                  \
+                                    FILL();                               \
+                            }                                             \
+                            if (COND) {                                   \
+                                    pc = code + pc->target;               \
+                                    SAFEPOINT();                          \
+                            } else {                                      \
+                                    ++pc;                                 \
+                            }
+
+#define CONDITIONAL_JMP(OP) COMPARE_JMP(b OP a)
+
+#define INT_CONDITIONAL_JMP(OP) COMPARE_JMP(slot_int(b) OP slot_int(a))
+
+void run_processor(const char *filename, const struct proc_opts *opts)
 {
-        FILE *bin = fopen(filename, "rb");
-        if (!bin) {
-                fprintf(stderr, "error: couldn't open file\n");
-                exit(1);
+        struct program prog = {};
+        struct processor processor = {};
+        struct profile prof = {};
+        struct sampler sampler = {};
+        struct trace trace = {};
+        struct fastio_in in = {};
+        struct fastio_out out = {};
+
+        int status = program_load(&prog, filename);
+        processor_ctor(&processor, &prog);
+        fastio_in_ctor(&in, STDIN_FILENO);
+        fastio_out_ctor(&out, STDOUT_FILENO, opts->flags & PROC_SHORTEST);
+        processor.io.in = fastio_read;
+        processor.io.out = fastio_write;
+        processor.io.in_ctx = &in;
+        processor.io.out_ctx = &out;
+        in.tie = &out;
+        if (opts->checkpoint) {
+                /* a checkpoint signal must not wait for more input */
+                in.stop = &processor.stop;
+                processor.io.interrupted = fastio_interrupted;
         }
-
-        return bin;
-}
-
-static void read_bin(FILE *bin, struct processor *processor)
-{
-        if (!bin || !processor || !processor->code) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
+        if (status == PROC_OK && opts->resume)
+                status = checkpoint_load(&processor, opts->resume);
+        if (status == PROC_OK && opts->profile) {
+                profile_ctor(&prof, prog.insns, prog.ninsns);
+                processor.prof = &prof;
         }
-
-        verify_signature(bin);
-        fread(processor->code, sizeof(char), codelen, bin);
-}
-
-static void verify_signature(FILE *bin)
-{
-        uint32_t signature = 0x61796b;
-        char tmp[sizeof(struct header)] = "";
-
-        fread(tmp, sizeof(struct header), 1, bin);
-        if (memcmp(tmp, &signature, sizeof(uint32_t)) != 0) {
-                fprintf(stderr, "error: unknown file format\n");
-                exit(1);
+        if (status == PROC_OK && opts->samples) {
+                sampler_ctor(&sampler, &prog);
+                processor.sampler = &sampler;
+                sampler_start(&sampler);
+        }
+        if (status == PROC_OK && opts->trace) {
+                trace_ctor(&trace, opts->trace);
+                processor.trace = &trace;
         }
-}
 
-static void execute_program(struct processor *processor)
-{
-        if (!processor || !processor->code) {
-                fprintf(stderr, "error: null pointer\n");
+        if (status == PROC_OK && (opts->flags & PROC_BATCH))
+                run_batch(&processor, opts->flags);
+        else if (status == PROC_OK && opts->checkpoint)
+                status = run_checkpointed(&processor, opts, &out);
+        else if (status == PROC_OK)
+                status = processor_run(&processor, opts->flags, -1);
+
+        if (processor.sampler)
+                sampler_stop(&sampler);
+        if (processor.trace) {
+                trace_dtor(&trace);
+                processor.trace = NULL;
+        }
+        fastio_flush(&out);
+        if (status != PROC_OK) {
+                if (prog.fault >= 0)
+                        fprintf(stderr, "error: %s at %d\n",
+                                        proc_strerror(status), prog.fault);
+                else
+                        fprintf(stderr, "error: %s\n", proc_strerror(status));
                 exit(1);
         }
 
-        while (1) {
-                char opcode = processor->code[processor->ip];
-                if (execute_cmd(processor, opcode) == 0)
-                        break;
+        if (processor.prof) {
+                write_profile(&processor, opts->profile);
+                profile_dtor(&prof);
+        }
+        if (processor.sampler) {
+                write_samples(&processor, opts->samples);
+                sampler_dtor(&sampler);
         }
+
+        fastio_in_dtor(&in);
+        fastio_out_dtor(&out);
+        processor_dtor(&processor);
+        program_dtor(&prog);
 }
 
-static int execute_cmd(struct processor *processor, int opcode)
+/*
+ * Run with a checkpoint after every checkpoint_every instructions and on
+ * every checkpoint signal, see checkpoint.cpp. Output is flushed first so
+ * that it matches the snapshot. Only the interpreter can stop mid-run, so
+ * the JIT and the register IR are not used. A finished run removes its
+ * checkpoint, a restart then starts over.
+ */
+static int run_checkpointed(struct processor *processor,
+                const struct proc_opts *opts, struct fastio_out *out)
 {
-        #ifdef DEBUG
-        processor_dump(processor);
-        #endif
-
-        switch (opcode) {
-                case CMD_HLT:
-                        return 0;
-                        break;
-                case CMD_PUSH:
-                        execute_cmd_push(processor);
-                        break;
-                case CMD_ADD:
-                        execute_cmd_add(processor);
-                        break;
-                case CMD_SUB:
-                        execute_cmd_sub(processor);
-                        break;
-                case CMD_MUL:
-                        execute_cmd_mul(processor);
-                        break;
-                case CMD_DIV:
-                        execute_cmd_div(processor);
-                        break;
-                case CMD_OUT:
-                        execute_cmd_out(processor);
-                        break;
-                case CMD_IN:
-                        execute_cmd_in(processor);
-                        break;
-                case CMD_SQRT:
-                        execute_cmd_sqrt(processor);
-                        break;
-                case CMD_SIN:
-                        execute_cmd_sin(processor);
-                        break;
-                case CMD_COS:
-                        execute_cmd_cos(processor);
-                        break;
-                case CMD_JMP:
-                        execute_cmd_jmp(processor);
-                        break;
-                case CMD_JA:
-                        execute_cmd_ja(processor);
-                        break;
-                case CMD_JAE:
-                        execute_cmd_jae(processor);
-                        break;
-                case CMD_JB:
-                        execute_cmd_jb(processor);
-                        break;
-                case CMD_JBE:
-                        execute_cmd_jbe(processor);
-                        break;
-                case CMD_JE:
-                        execute_cmd_je(processor);
-                        break;
-                case CMD_JNE:
-                        execute_cmd_jne(processor);
-                        break;
-                default:
-                        fprintf(stderr, "error: invalid instruction\n");
-                        exit(1);
+        int flags = opts->flags & ~(PROC_JIT | PROC_REG);
+        long every = opts->checkpoint_every > 0 ? opts->checkpoint_every : -1;
+        checkpoint_signals(processor);
+
+        for (;;) {
+                int status = processor_run(processor, flags, every);
+                if (status == PROC_OK)
+                        unlink(opts->checkpoint);
+                if (status != PROC_BUDGET && status != PROC_STOPPED)
+                        return status;
+
+                fastio_flush(out);
+                int saved = checkpoint_save(processor, opts->checkpoint);
+                if (saved != PROC_OK)
+                        return saved;
+                if (status == PROC_STOPPED &&
+                                checkpoint_last_signal() != SIGUSR1)
+                        return status;
         }
-        return -1;
 }
 
-static void execute_cmd_push(struct processor *processor)
+/* map and decode the binary, returns an enum proc_status */
+int program_load(struct program *prog, const char *filename)
 {
-        if (!processor || !processor->code) {
+        if (!prog || !filename) {
                 fprintf(stderr, "error: null pointer\n");
                 exit(1);
         }
 
-        ++processor->ip;
-
-        double arg = 0;
-        memcpy(&arg, processor->code + processor->ip, sizeof(double));
-        stack_push(&processor->stk, &arg);
-
-        processor->ip += sizeof(double);
-}
+        prog->fault = -1;
+        prog->max_depth = -1;
+        int bin = open(filename, O_RDONLY);
+        if (bin < 0)
+                return PROC_ERR_OPEN;
 
-static void execute_cmd_out(struct processor *processor)
-{
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
+        struct stat st = {};
+        if (fstat(bin, &st) < 0) {
+                close(bin);
+                return PROC_ERR_OPEN;
+        }
+        if ((size_t) st.st_size < sizeof(struct header)) {
+                close(bin);
+                return PROC_ERR_FORMAT;
         }
 
-        ++processor->ip;
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, bin, 0);
+        close(bin);
+        if (map == MAP_FAILED)
+                return PROC_ERR_OPEN;
+        prog->image = map;
+        prog->image_size = st.st_size;
+        prog->mapped = 1;
 
-        stack_peek(&processor->stk);
+        return read_image(prog);
 }
 
-static void execute_cmd_add(struct processor *processor)
+/* load a binary image from memory, the program keeps its own copy */
+int program_load_mem(struct program *prog, const void *data, size_t size)
 {
-        if (!processor) {
+        if (!prog || !data) {
                 fprintf(stderr, "error: null pointer\n");
                 exit(1);
         }
 
-        BIN_ARITHMETIC(+);
-}
+        prog->fault = -1;
+        prog->max_depth = -1;
+        if (size < sizeof(struct header))
+                return PROC_ERR_FORMAT;
 
-static void execute_cmd_sub(struct processor *processor)
-{
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
+        prog->image = malloc(size);
+        if (!prog->image) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
                 exit(1);
         }
+        memcpy(prog->image, data, size);
+        prog->image_size = size;
+        prog->mapped = 0;
 
-        BIN_ARITHMETIC(-);
+        return read_image(prog);
 }
 
-static void execute_cmd_mul(struct processor *processor)
+/* safe to call after a failed load */
+void program_dtor(struct program *prog)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
-        }
-
-        BIN_ARITHMETIC(*);
+        reg_dtor(prog);
+        decode_dtor(prog);
+        if (prog->mapped)
+                munmap(prog->image, prog->image_size);
+        else
+                free(prog->image);
+        prog->image = NULL;
+        prog->code = NULL;
 }
 
-static void execute_cmd_div(struct processor *processor)
+/* check the header of prog->image and decode the code after it */
+static int read_image(struct program *prog)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
+        struct header header = {};
+        memcpy(&header, prog->image, sizeof(struct header));
+        if (!verify_signature(&header))
+                return PROC_ERR_FORMAT;
+
+        if (header.size > prog->image_size - sizeof(struct header))
+                return PROC_ERR_TRUNCATED;
+        if (header.size >= INT_MAX)
+                return PROC_ERR_TOO_LARGE;
+
+        prog->code = (const char *) prog->image + sizeof(struct header);
+        prog->size = header.size;
+
+        int status = decode_program(prog);
+        decode_lines(prog, &header);
+        if (status == PROC_OK) {
+                verify_program(prog);
+                reg_compile(prog);
         }
-
-        BIN_ARITHMETIC(/);
+        return status;
 }
 
-static void execute_cmd_in(struct processor *processor)
+static int verify_signature(struct header *header)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
-        }
+        uint32_t signature = 0x61796b;
 
-        double arg = 0;
-        scanf("%lg", &arg);
-        stack_push(&processor->stk, &arg);
+        return header->signature == signature;
 }
 
-static void execute_cmd_sqrt(struct processor *processor)
+/*
+ * Instances are cheap: the program is shared, only the stack, registers
+ * and RAM are owned. Verified programs get a stack of exactly their
+ * maximum depth, RAM is only allocated for programs that address it.
+ */
+void processor_ctor(struct processor *processor, const struct program *prog)
 {
-        if (!processor) {
+        if (!processor || !prog) {
                 fprintf(stderr, "error: null pointer\n");
                 exit(1);
         }
 
-        UNARY_ARITHMETIC(sqrt);
+        processor->prog = prog;
+        dstack_ctor(&processor->stk, prog->depths ? prog->max_depth : 10);
+        processor->ram = NULL;
+        if (prog->uses_ram) {
+                /* whole cache lines, so no two processors share one */
+                processor->ram = (double *) aligned_alloc(64,
+                                ram_size * sizeof(double));
+                if (!processor->ram) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+        }
+        processor->io.in = proc_file_in;
+        processor->io.out = proc_file_out;
+        processor->io.interrupted = NULL;
+        processor->io.in_ctx = stdin;
+        processor->io.out_ctx = stdout;
+        processor_reset(processor);
 }
 
-static void execute_cmd_sin(struct processor *processor)
+void processor_dtor(struct processor *processor)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
-        }
-
-        UNARY_ARITHMETIC(sin);
+        dstack_dtor(&processor->stk);
+        free(processor->ram);
+        processor->ram = NULL;
+        processor->prog = NULL;
 }
 
-static void execute_cmd_cos(struct processor *processor)
+/* start over from the first insn with registers and RAM cleared, the
+ * stack keeps its memory */
+void processor_reset(struct processor *processor)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
-        }
-
-        UNARY_ARITHMETIC(cos);
+        processor->ip = 0;
+        processor->stk.size = 0;
+        memset(processor->regs, 0, sizeof(processor->regs));
+        if (processor->ram)
+                memset(processor->ram, 0, ram_size * sizeof(double));
+        processor->budget = -1;
+        processor->stop = 0;
 }
 
-static void execute_cmd_jmp(struct processor *processor)
+/*
+ * Run from processor->ip until hlt or until budget instructions have
+ * executed (-1 for no limit); returns an enum proc_status. PROC_BUDGET
+ * leaves the processor ready to continue with another call.
+ */
+int processor_run(struct processor *processor, int flags, long budget)
 {
-        if (!processor || !processor->code) {
+        if (!processor || !processor->prog || !processor->prog->insns) {
                 fprintf(stderr, "error: null pointer\n");
                 exit(1);
         }
 
-        ++processor->ip;
+        processor->budget = budget;
+        /* the JIT only runs whole programs */
+        int observed = processor->prof || processor->sampler ||
+                processor->trace;
+        if ((flags & PROC_JIT) && !observed && budget < 0 &&
+                        processor->ip == 0 && processor->stk.size == 0 &&
+                        jit_run(processor, flags) >= 0)
+                return PROC_OK;
+        if ((flags & PROC_REG) && !observed && budget < 0 &&
+                        reg_run(processor, flags) >= 0)
+                return PROC_OK;
+
+        const struct program *prog = processor->prog;
+        int verified = prog->depths &&
+                processor->stk.size == prog->depths[processor->ip];
+        if (verified)
+                dstack_reserve(&processor->stk, prog->max_depth);
+
+        return verified ? execute_program<1>(processor, flags) :
+                execute_program<0>(processor, flags);
+}
 
-        int arg = 0;
-        memcpy(&arg, processor->code + processor->ip, sizeof(int));
-        processor->ip = arg;
+const char *proc_strerror(int status)
+{
+        static const char *const messages[] = {
+                "success",
+                "instruction budget exhausted",
+                "stopped",
+                "couldn't open file",
+                "unknown file format",
+                "truncated file",
+                "program too large",
+                "invalid instruction",
+                "invalid jump target",
+                "bad checkpoint",
+                "address out of range",
+        };
+        static_assert(sizeof(messages) / sizeof(messages[0]) == PROC_ERR_COUNT,
+                        "every enum proc_status needs a message");
+
+        if (status < 0 || status >= PROC_ERR_COUNT)
+                return "unknown error";
+        return messages[status];
 }
 
-static void execute_cmd_ja(struct processor *processor)
+/* default in/out: scanf/printf on a FILE * */
+double proc_file_in(void *file)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
-        }
+        double arg = 0;
+        fscanf((FILE *) file, "%lg", &arg);
+        return arg;
+}
 
-        CONDITIONAL_JMP(>);
+void proc_file_out(void *file, double val)
+{
+        fprintf((FILE *) file, "%lg\n", val);
 }
 
-static void execute_cmd_jae(struct processor *processor)
+template <int verified>
+static int execute_program(struct processor *processor, int flags)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
+        /* tables are per call so that threads never share them */
+        #ifndef DISPATCH_SWITCH
+        const void *dispatch[256];
+        const void *volatile hooks[256];
+        for (int i = 0; i < 256; ++i) {
+                dispatch[i] = &&invalid;
+                hooks[i] = &&hook;
         }
+        TARGET(CMD_HLT);
+        TARGET(CMD_PUSH);
+        TARGET(CMD_ADD);
+        TARGET(CMD_SUB);
+        TARGET(CMD_MUL);
+        TARGET(CMD_DIV);
+        TARGET(CMD_OUT);
+        TARGET(CMD_IN);
+        TARGET(CMD_SQRT);
+        TARGET(CMD_SIN);
+        TARGET(CMD_COS);
+        TARGET(CMD_JMP);
+        TARGET(CMD_JA);
+        TARGET(CMD_JAE);
+        TARGET(CMD_JB);
+        TARGET(CMD_JBE);
+        TARGET(CMD_JE);
+        TARGET(CMD_JNE);
+        TARGET(CMD_PUSH_ADD);
+        TARGET(CMD_PUSH_MUL);
+        TARGET(CMD_PUSH_JB);
+        TARGET(CMD_OUT_HLT);
+        TARGET(CMD_SINCOS);
+        TARGET(CMD_IPUSH);
+        TARGET(CMD_IADD);
+        TARGET(CMD_ISUB);
+        TARGET(CMD_IMUL);
+        TARGET(CMD_IDIV);
+        TARGET(CMD_IJA);
+        TARGET(CMD_IJAE);
+        TARGET(CMD_IJB);
+        TARGET(CMD_IJBE);
+        TARGET(CMD_IJE);
+        TARGET(CMD_IJNE);
+        TARGET(CMD_ITOF);
+        TARGET(CMD_FTOI);
+        TARGET(CMD_IPUSH_ADD);
+        TARGET(CMD_PUSH_REG);
+        TARGET(CMD_POP_REG);
+        TARGET(CMD_PUSH_MEM);
+        TARGET(CMD_POP_MEM);
+        #endif
 
-        CONDITIONAL_JMP(>=);
-}
+        const struct insn *code = processor->prog->insns;
+        const struct insn *pc = code + processor->ip;
+        struct dstack *stk = &processor->stk;
+        struct sampler *sampler = processor->sampler;
+        double *base = NULL, *sp = NULL, *limit = NULL;
+        double tos = 0;
+        int fast = (flags & PROC_FAST_MATH) != 0;
+        FILL();
+
+        int hooked = processor->prof != NULL || processor->trace != NULL ||
+                processor->budget >= 0;
+        #ifndef DISPATCH_SWITCH
+        const void *volatile *ops = (const void *volatile *) dispatch;
+        if (sampler)
+                ops = sampler_attach(sampler, dispatch, &&sample);
+        const void *volatile *table = hooked ? hooks : ops;
+        #else
+        hooked |= sampler != NULL;
+        #endif
 
-static void execute_cmd_jb(struct processor *processor)
-{
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
+        ENGINE_BEGIN()
+
+        OP(CMD_HLT) {
+                SPILL();
+                processor->ip = pc - code;
+                return PROC_OK;
+        }
+        OP(CMD_PUSH) {
+                PUSH(pc->arg);
+                ++pc;
+                NEXT();
+        }
+        OP(CMD_ADD) {
+                BIN_ARITHMETIC(+);
+                NEXT();
+        }
+        OP(CMD_SUB) {
+                BIN_ARITHMETIC(-);
+                NEXT();
+        }
+        OP(CMD_MUL) {
+                BIN_ARITHMETIC(*);
+                NEXT();
+        }
+        OP(CMD_DIV) {
+                BIN_ARITHMETIC(/);
+                NEXT();
+        }
+        OP(CMD_OUT) {
+                ++pc;
+                if (verified || sp != base)
+                        processor->io.out(processor->io.out_ctx, tos);
+                NEXT();
+        }
+        OP(CMD_IN) {
+                double arg = processor->io.in(processor->io.in_ctx);
+                if (processor->io.interrupted &&
+                                processor->io.interrupted(processor->io.in_ctx))
+                        goto stopped;
+                ++pc;
+                PUSH(arg);
+                NEXT();
+        }
+        OP(CMD_SQRT) {
+                UNARY_ARITHMETIC(math_sqrt);
+                NEXT();
+        }
+        OP(CMD_SIN) {
+                UNARY_ARITHMETIC(math_sin);
+                NEXT();
+        }
+        OP(CMD_COS) {
+                UNARY_ARITHMETIC(math_cos);
+                NEXT();
+        }
+        OP(CMD_SINCOS) {
+                ++pc;
+                double s = 0, c = 0;
+                if (verified || sp != base) {
+                        math_sincos(tos, fast, &s, &c);
+                        tos = s;
+                } else {
+                        math_sincos(0.0, fast, &s, &c);
+                        PUSH(s);
+                }
+                PUSH(c);
+                NEXT();
+        }
+        OP(CMD_JMP) {
+                pc = code + pc->target;
+                SAFEPOINT();
+                NEXT();
+        }
+        OP(CMD_JA) {
+                CONDITIONAL_JMP(>);
+                NEXT();
+        }
+        OP(CMD_JAE) {
+                CONDITIONAL_JMP(>=);
+                NEXT();
+        }
+        OP(CMD_JB) {
+                CONDITIONAL_JMP(<);
+                NEXT();
+        }
+        OP(CMD_JBE) {
+                CONDITIONAL_JMP(<=);
+                NEXT();
+        }
+        OP(CMD_JE) {
+                CONDITIONAL_JMP(==);
+                NEXT();
+        }
+        OP(CMD_JNE) {
+                CONDITIONAL_JMP(!=);
+                NEXT();
+        }
+        OP(CMD_PUSH_ADD) {
+                IMM_ARITHMETIC(+);
+                NEXT();
+        }
+        OP(CMD_PUSH_MUL) {
+                IMM_ARITHMETIC(*);
+                NEXT();
+        }
+        OP(CMD_PUSH_JB) {
+                double b = 0;
+                if (verified || sp != base) {
+                        b = tos;
+                        --sp;
+                        tos = sp[-1];
+                }
+                if (b < pc->arg) {
+                        pc = code + pc->target;
+                        SAFEPOINT();
+                } else {
+                        ++pc;
+                }
+                NEXT();
+        }
+        OP(CMD_OUT_HLT) {
+                SPILL();
+                if (verified || sp != base)
+                        processor->io.out(processor->io.out_ctx, tos);
+                processor->ip = pc - code;
+                return PROC_OK;
         }
 
-        CONDITIONAL_JMP(<);
-}
+        OP(CMD_IPUSH_ADD) {
+                if (verified || sp != base) {
+                        tos = slot_iadd(tos, pc->arg);
+                } else {
+                        PUSH(pc->arg);
+                }
+                ++pc;
+                NEXT();
+        }
+        OP(CMD_IPUSH) {
+                PUSH(pc->arg);
+                ++pc;
+                NEXT();
+        }
+        OP(CMD_IADD) {
+                INT_ARITHMETIC(slot_iadd);
+                NEXT();
+        }
+        OP(CMD_ISUB) {
+                INT_ARITHMETIC(slot_isub);
+                NEXT();
+        }
+        OP(CMD_IMUL) {
+                INT_ARITHMETIC(slot_imul);
+                NEXT();
+        }
+        OP(CMD_IDIV) {
+                INT_ARITHMETIC(slot_idiv);
+                NEXT();
+        }
+        OP(CMD_IJA) {
+                INT_CONDITIONAL_JMP(>);
+                NEXT();
+        }
+        OP(CMD_IJAE) {
+                INT_CONDITIONAL_JMP(>=);
+                NEXT();
+        }
+        OP(CMD_IJB) {
+                INT_CONDITIONAL_JMP(<);
+                NEXT();
+        }
+        OP(CMD_IJBE) {
+                INT_CONDITIONAL_JMP(<=);
+                NEXT();
+        }
+        OP(CMD_IJE) {
+                INT_CONDITIONAL_JMP(==);
+                NEXT();
+        }
+        OP(CMD_IJNE) {
+                INT_CONDITIONAL_JMP(!=);
+                NEXT();
+        }
+        /* on an empty stack both push 0, which is 0 in either type */
+        OP(CMD_ITOF) {
+                ++pc;
+                if (verified || sp != base) {
+                        tos = slot_itof(tos);
+                } else {
+                        PUSH(0.0);
+                }
+                NEXT();
+        }
+        OP(CMD_FTOI) {
+                ++pc;
+                if (verified || sp != base) {
+                        tos = slot_ftoi(tos);
+                } else {
+                        PUSH(0.0);
+                }
+                NEXT();
+        }
 
-static void execute_cmd_jbe(struct processor *processor)
-{
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
-                exit(1);
+        OP(CMD_PUSH_REG) {
+                PUSH(processor->regs[pc->mem.reg]);
+                ++pc;
+                NEXT();
+        }
+        OP(CMD_POP_REG) {
+                double a = 0;
+                if (verified || sp != base) {
+                        a = tos;
+                        --sp;
+                        tos = sp[-1];
+                }
+                processor->regs[pc->mem.reg] = a;
+                ++pc;
+                NEXT();
+        }
+        OP(CMD_PUSH_MEM) {
+                RAM_ADDRESS();
+                PUSH(processor->ram[addr]);
+                ++pc;
+                NEXT();
         }
+        OP(CMD_POP_MEM) {
+                RAM_ADDRESS();
+                double a = 0;
+                if (verified || sp != base) {
+                        a = tos;
+                        --sp;
+                        tos = sp[-1];
+                }
+                processor->ram[addr] = a;
+                ++pc;
+                NEXT();
+        }
+
+        ENGINE_END()
+
+#ifndef DISPATCH_SWITCH
+hook:
+        HOOK();
+        goto *ops[pc->op];
+
+sample:
+        sampler_take(sampler, pc - code);
+        sampler_restore(sampler, dispatch);
+        goto *dispatch[pc->op];
+#endif
 
-        CONDITIONAL_JMP(<=);
+out_of_budget:
+        processor->budget = 0;
+        SPILL();
+        processor->ip = pc - code;
+        return PROC_BUDGET;
+
+stopped:
+        processor->stop = 0;
+        SPILL();
+        processor->ip = pc - code;
+        return PROC_STOPPED;
+
+invalid:
+        SPILL();
+        processor->ip = pc - code;
+        return PROC_ERR_INSN;
+
+bad_address:
+        SPILL();
+        processor->ip = pc - code;
+        return PROC_ERR_ADDRESS;
 }
 
-static void execute_cmd_je(struct processor *processor)
+static void write_profile(struct processor *processor, const char *filename)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
+        FILE *out = fopen(filename, "w");
+        if (!out) {
+                fprintf(stderr, "error: couldn't open file\n");
                 exit(1);
         }
 
-        CONDITIONAL_JMP(==);
+        profile_report(processor->prof, processor->prog->offsets, out);
+        fclose(out);
 }
 
-static void execute_cmd_jne(struct processor *processor)
+static void write_samples(struct processor *processor, const char *filename)
 {
-        if (!processor) {
-                fprintf(stderr, "error: null pointer\n");
+        FILE *out = fopen(filename, "w");
+        if (!out) {
+                fprintf(stderr, "error: couldn't open file\n");
                 exit(1);
         }
 
-        CONDITIONAL_JMP(!=);
+        sampler_report(processor->sampler, processor->prog, out);
+        fclose(out);
 }
-
-#ifdef DEBUG
-static void processor_dump(struct processor *processor)
-{
-        int mod = 16;
-
-        printf("-----------------------------------------------\n");
-        for (int i = 0; i < mod; ++i)
-                printf("%02X ", i);
-        printf("\n\n");
-
-        for (int i = 0; i < mod; ++i)
-                printf("%02X ", (unsigned char) processor->code[i +
-                                (processor->ip / mod) * mod]);
-        printf("\n");
-
-        int remainder = processor->ip % mod;
-        for (int i = 0; i < 3*remainder; ++i)
-                printf(" ");
-        printf("^ip = %d\n\n", processor->ip);
-        printf("-----------------------------------------------\n");
-}
-#endif
@@ -1,15 +1,137 @@
 #ifndef PROCESSOR_H
 #define PROCESSOR_H
 
+#include <stdio.h>
+#include <signal.h>
 #include "common.h"
 #include "stack.h"
 
+struct profile;
+struct sampler;
+struct trace;
+struct reg_code;
+
+/* register and RAM operand of a decoded push/pop */
+struct insn_mem {
+        int reg;                /* register, reg_count for none */
+        int disp;               /* added to the register for RAM */
+};
+
+/* decoded instruction, see decode.cpp */
+struct insn {
+        int op;                 /* handler, one of enum cmd */
+        int target;             /* jump target as an instruction index */
+        union {
+                double arg;     /* immediate operand */
+                struct insn_mem mem;
+        };
+};
+
+/* decoded binary, immutable once loaded and shared by any number of
+ * processors (also across threads) */
+struct program {
+        void *image;            /* the whole binary */
+        size_t image_size;
+        int mapped;             /* image is an mmap, else a malloc'd copy */
+        const char *code;       /* code inside the image */
+        int size;               /* code size in bytes from the header */
+        struct insn *insns;
+        int *offsets;           /* byte offset of every decoded insn */
+        int ninsns;
+        int *depths;            /* static stack depth before every insn,
+                                   NULL unless verified */
+        int max_depth;          /* -1 unless verified */
+        int uses_ram;           /* has push/pop [addr] */
+        struct reg_code *reg;   /* register IR, NULL unless verified and
+                                   free of int64, register and RAM
+                                   instructions */
+        struct debug_line *lines;       /* line table, NULL unless the
+                                           binary has HEADER_DEBUG */
+        int nlines;
+        const char *names;      /* names of the line table, in the image */
+        int fault;              /* byte offset of a decode error, or -1 */
+};
+
+/*
+ * in/out callbacks, ctx is passed through untouched. An in that can give
+ * up when stop is raised reports it through interrupted, and the
+ * interpreter stops before the in so that it runs again on resume.
+ */
+struct proc_io {
+        double (*in)(void *ctx);
+        void (*out)(void *ctx, double val);
+        int (*interrupted)(void *in_ctx);       /* NULL if in never gives up */
+        void *in_ctx;
+        void *out_ctx;
+};
+
 struct processor {
-        char code[codelen];
-        int ip;
-        struct stack stk;
+        const struct program *prog;
+        int ip;                 /* index into prog->insns */
+        struct dstack stk;
+        double regs[reg_count + 1];     /* the last one is always 0, the
+                                           base register of [imm] */
+        double *ram;            /* ram_size slots, NULL unless
+                                   prog->uses_ram */
+        struct profile *prof;   /* execution profile, NULL if disabled */
+        struct sampler *sampler;        /* SIGPROF sampler, NULL if
+                                           disabled */
+        struct trace *trace;    /* execution trace, NULL if disabled */
+        struct proc_io io;      /* stdin/stdout unless replaced */
+        long budget;            /* instructions left, -1 for no limit */
+        volatile sig_atomic_t stop;     /* stop at the next taken jump */
 };
 
-void run_processor(const char *filename);
+/* errors are returned instead of terminating, so many programs can share
+ * one process */
+enum proc_status {
+        PROC_OK = 0,
+        PROC_BUDGET,            /* budget ran out, run again to resume */
+        PROC_STOPPED,           /* stop was raised, run again to resume */
+        PROC_ERR_OPEN,          /* couldn't open or map the binary */
+        PROC_ERR_FORMAT,        /* bad signature */
+        PROC_ERR_TRUNCATED,     /* header size past the end of the file */
+        PROC_ERR_TOO_LARGE,
+        PROC_ERR_INSN,          /* invalid or truncated instruction */
+        PROC_ERR_TARGET,        /* jump into the middle of an instruction */
+        PROC_ERR_CHECKPOINT,    /* bad checkpoint or one of another program */
+        PROC_ERR_ADDRESS,       /* RAM address out of range */
+        PROC_ERR_COUNT,
+};
+
+enum proc_flags {
+        PROC_JIT = 1 << 0,      /* run through the x86-64 JIT if possible */
+        PROC_BATCH = 1 << 1,    /* one run per input line, SIMD lanes */
+        PROC_SHORTEST = 1 << 2, /* print shortest round-trip numbers */
+        PROC_REG = 1 << 3,      /* run on the register IR if possible */
+        PROC_FAST_MATH = 1 << 4,        /* polynomial sin/cos, see
+                                           fastmath.h */
+};
+
+struct proc_opts {
+        int flags;              /* enum proc_flags */
+        const char *profile;    /* profile report file, NULL if disabled */
+        const char *samples;    /* folded stacks file, NULL if disabled */
+        const char *trace;      /* binary trace file, NULL if disabled */
+        const char *checkpoint; /* checkpoint file, NULL if disabled */
+        long checkpoint_every;  /* instructions between checkpoints, 0 for
+                                   on signals only */
+        const char *resume;     /* checkpoint to continue from, or NULL */
+};
+
+void run_processor(const char *filename, const struct proc_opts *opts);
+
+int program_load(struct program *prog, const char *filename);
+int program_load_mem(struct program *prog, const void *data, size_t size);
+void program_dtor(struct program *prog);
+
+void processor_ctor(struct processor *processor, const struct program *prog);
+void processor_dtor(struct processor *processor);
+void processor_reset(struct processor *processor);
+int processor_run(struct processor *processor, int flags, long budget);
+const char *proc_strerror(int status);
+
+double proc_file_in(void *file);
+void proc_file_out(void *file, double val);
 
 #endif
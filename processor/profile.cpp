@@ -0,0 +1,128 @@
+/*
+ * profile - per-opcode and per-address execution profile
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "common.h"
+#include "profile.h"
+
+static uint64_t *alloc_counters(int n);
+
+void profile_ctor(struct profile *prof, const struct insn *insns, int ninsns)
+{
+        if (!prof) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        prof->insns = insns;
+        prof->ninsns = ninsns;
+        prof->count = alloc_counters(ninsns);
+        prof->cycles = alloc_counters(ninsns);
+        prof->samples = alloc_counters(ninsns);
+        prof->taken = alloc_counters(ninsns);
+        prof->not_taken = alloc_counters(ninsns);
+        prof->max_depth = 0;
+
+        prof->prev = -1;
+        prof->sampled = -1;
+        prof->countdown = profile_period;
+        prof->rng = 0x2545f491;
+        prof->t0 = 0;
+}
+
+void profile_dtor(struct profile *prof)
+{
+        free(prof->count);
+        free(prof->cycles);
+        free(prof->samples);
+        free(prof->taken);
+        free(prof->not_taken);
+        memset(prof, 0, sizeof(struct profile));
+}
+
+static uint64_t *alloc_counters(int n)
+{
+        uint64_t *counters = (uint64_t *) calloc(n, sizeof(uint64_t));
+        if (!counters) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        return counters;
+}
+
+/* estimated total cycles: mean sampled cost times execution count */
+static uint64_t estimate(uint64_t count, uint64_t cycles, uint64_t samples)
+{
+        return samples ? (uint64_t) ((double) cycles / samples * count) : 0;
+}
+
+/*
+ * The report is JSON: totals, then one record per opcode and one per
+ * executed bytecode address (byte offset in the binary). Cycle counts
+ * are sampled about every profile_period instructions and include the
+ * dispatch of the measured instruction.
+ */
+void profile_report(struct profile *prof, const int *offsets, FILE *out)
+{
+        uint64_t op_count[CMD_COUNT] = {};
+        uint64_t op_cycles[CMD_COUNT] = {};
+        uint64_t op_samples[CMD_COUNT] = {};
+        uint64_t total = 0;
+
+        for (int i = 0; i < prof->ninsns; ++i) {
+                int op = prof->insns[i].op;
+                op_count[op] += prof->count[i];
+                op_cycles[op] += prof->cycles[i];
+                op_samples[op] += prof->samples[i];
+                total += prof->count[i];
+        }
+
+        fprintf(out, "{\n");
+        fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long) total);
+        fprintf(out, "  \"max_stack_depth\": %d,\n", prof->max_depth);
+        fprintf(out, "  \"sample_period\": %d,\n", profile_period);
+
+        fprintf(out, "  \"opcodes\": [");
+        const char *sep = "\n";
+        for (int op = 0; op < CMD_COUNT; ++op) {
+                if (!op_count[op])
+                        continue;
+                fprintf(out, "%s    {\"op\": \"%s\", \"count\": %llu, "
+                                "\"samples\": %llu, \"cycles\": %llu, "
+                                "\"est_cycles\": %llu}", sep, cmd_names[op],
+                                (unsigned long long) op_count[op],
+                                (unsigned long long) op_samples[op],
+                                (unsigned long long) op_cycles[op],
+                                (unsigned long long) estimate(op_count[op],
+                                        op_cycles[op], op_samples[op]));
+                sep = ",\n";
+        }
+        fprintf(out, "\n  ],\n");
+
+        fprintf(out, "  \"addresses\": [");
+        sep = "\n";
+        for (int i = 0; i < prof->ninsns; ++i) {
+                if (!prof->count[i])
+                        continue;
+                int op = prof->insns[i].op;
+                fprintf(out, "%s    {\"ip\": %d, \"op\": \"%s\", \"count\": %llu, "
+                                "\"samples\": %llu, \"cycles\": %llu, "
+                                "\"est_cycles\": %llu", sep, offsets[i],
+                                cmd_names[op],
+                                (unsigned long long) prof->count[i],
+                                (unsigned long long) prof->samples[i],
+                                (unsigned long long) prof->cycles[i],
+                                (unsigned long long) estimate(prof->count[i],
+                                        prof->cycles[i], prof->samples[i]));
+                if (cmd_is_jmp(op) && op != CMD_JMP)
+                        fprintf(out, ", \"taken\": %llu, \"not_taken\": %llu",
+                                        (unsigned long long) prof->taken[i],
+                                        (unsigned long long) prof->not_taken[i]);
+                fprintf(out, "}");
+                sep = ",\n";
+        }
+        fprintf(out, "\n  ]\n}\n");
+}
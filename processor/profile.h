@@ -0,0 +1,88 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "common.h"
+#include "processor.h"
+
+/*
+ * On average every profile_period-th instruction gets its cycle cost
+ * measured; the interval is jittered so loops whose length divides the
+ * period don't alias onto the same few instructions.
+ */
+const int profile_period = 64;
+
+/* per-instruction counters, indexed like processor->insns */
+struct profile {
+        const struct insn *insns;
+        int ninsns;
+        uint64_t *count;
+        uint64_t *cycles;
+        uint64_t *samples;
+        uint64_t *taken;
+        uint64_t *not_taken;
+        int max_depth;
+
+        int prev;               /* previously executed insn, -1 at start */
+        int sampled;            /* insn being timed, -1 if none */
+        int countdown;
+        uint32_t rng;
+        uint64_t t0;
+};
+
+void profile_ctor(struct profile *prof, const struct insn *insns, int ninsns);
+void profile_dtor(struct profile *prof);
+void profile_report(struct profile *prof, const int *offsets, FILE *out);
+
+static inline uint64_t profile_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts = {};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/* called by the interpreter before executing insn ip at stack depth */
+static inline void profile_step(struct profile *prof, int ip, int depth)
+{
+        if (prof->sampled >= 0) {
+                prof->cycles[prof->sampled] += profile_clock() - prof->t0;
+                ++prof->samples[prof->sampled];
+                prof->sampled = -1;
+        }
+
+        if (prof->prev >= 0) {
+                const struct insn *prev = &prof->insns[prof->prev];
+                if (cmd_is_jmp(prev->op) && prev->op != CMD_JMP) {
+                        if (ip == prev->target)
+                                ++prof->taken[prof->prev];
+                        else
+                                ++prof->not_taken[prof->prev];
+                }
+        }
+        prof->prev = ip;
+
+        ++prof->count[ip];
+        if (depth > prof->max_depth)
+                prof->max_depth = depth;
+
+        if (--prof->countdown == 0) {
+                prof->rng ^= prof->rng << 13;
+                prof->rng ^= prof->rng >> 17;
+                prof->rng ^= prof->rng << 5;
+                prof->countdown = profile_period / 2 +
+                        prof->rng % profile_period;
+                prof->sampled = ip;
+                prof->t0 = profile_clock();
+        }
+}
+
+#endif
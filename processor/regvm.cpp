@@ -0,0 +1,529 @@
+/*
+ * regvm - register IR built from the stack bytecode at load time
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "common.h"
+#include "processor.h"
+#include "regvm.h"
+#include "fastmath.h"
+
+/*
+ * Verified programs have a static stack depth before every instruction,
+ * so the stack slot an instruction reads or writes is known at load
+ * time. Every slot becomes a register and every pushed constant gets a
+ * register of its own. Within a basic block the translator keeps map[],
+ * the register currently holding each depth: a push only points its
+ * depth at the constant, and an operation reads its operands through
+ * map[]. Results go to an accumulator that the engine keeps in a local,
+ * so chains of operations never wait on a store and a reload; the
+ * accumulator is stored into its slot only when another result needs
+ * it or the block ends. "push 2; add" becomes one acc = acc + r[c] and
+ * "in; push 0; jne" an in and a jne. At the end of a block constants
+ * still in map[] are stored into their slots as well, so every block
+ * starts with each depth in its own register.
+ *
+ * Suffixes name the operands: A the accumulator, R a register.
+ */
+#define ROPS(X)                                                         \
+        X(R_HLT)                /* b: depth, target: insn index */      \
+        X(R_OUT_HLT)            /* a: value, b and target as R_HLT */   \
+        X(R_MOV)                                                        \
+        X(R_STORE)              /* r[dst] = acc */                      \
+        X(R_ADD_AR) X(R_ADD_RA) X(R_ADD_RR)                             \
+        X(R_SUB_AR) X(R_SUB_RA) X(R_SUB_RR)                             \
+        X(R_MUL_AR) X(R_MUL_RA) X(R_MUL_RR)                             \
+        X(R_DIV_AR) X(R_DIV_RA) X(R_DIV_RR)                             \
+        X(R_SQRT_A) X(R_SQRT_R)                                         \
+        X(R_SIN_A) X(R_SIN_R)                                           \
+        X(R_COS_A) X(R_COS_R)                                           \
+        X(R_SINCOS_A) X(R_SINCOS_R)     /* r[dst] = sin, acc = cos */   \
+        X(R_IN)                                                         \
+        X(R_OUT_A) X(R_OUT_R)                                           \
+        X(R_JMP)                                                        \
+        X(R_JA_AR) X(R_JAE_AR) X(R_JB_AR)                               \
+        X(R_JBE_AR) X(R_JE_AR) X(R_JNE_AR)                              \
+        X(R_JA_RR) X(R_JAE_RR) X(R_JB_RR)                               \
+        X(R_JBE_RR) X(R_JE_RR) X(R_JNE_RR)
+
+#define ROP_ENUM(OP) OP,
+enum rop {
+        ROPS(ROP_ENUM)
+};
+
+/* map[] entry of the depth held by the accumulator */
+const int reg_acc = -1;
+
+struct reg_builder {
+        const struct program *prog;
+        struct reg_code *reg;
+        int capacity;
+        int *map;               /* register holding each stack depth */
+        int *dirty;             /* depths that may map to a constant */
+        int ndirty;
+        int acc;                /* depth in the accumulator, or -1 */
+};
+
+static void translate_insn(struct reg_builder *b, const struct insn *insn,
+                int depth, int index);
+static void emit_binary(struct reg_builder *b, int op, int depth, int rb);
+static void emit_jump(struct reg_builder *b, int op, int ra, int rb,
+                int target);
+static void claim_acc(struct reg_builder *b, int keep1, int keep2);
+static void flush(struct reg_builder *b, int depth);
+
+static int add_const(struct reg_builder *b, double val);
+static void emit(struct reg_builder *b, int op, int dst, int a, int rb,
+                int target);
+static int rop_is_jmp(int op);
+
+void reg_compile(struct program *prog)
+{
+        prog->reg = NULL;
+        if (!prog->depths)
+                return;
+        /* the int64 instructions are left to the interpreter and JIT,
+           registers and RAM to the interpreter */
+        for (int i = 0; i < prog->ninsns; ++i)
+                if (cmd_is_int(prog->insns[i].op) ||
+                                cmd_has_reg(prog->insns[i].op))
+                        return;
+
+        int n = prog->ninsns;
+        struct reg_builder b = {};
+        b.prog = prog;
+        b.reg = (struct reg_code *) calloc(1, sizeof(struct reg_code));
+        int *leader = (int *) calloc(n, sizeof(int));
+        int *start = (int *) malloc(n * sizeof(int));
+        b.map = (int *) malloc((prog->max_depth + 1) * sizeof(int));
+        b.dirty = (int *) malloc(n * sizeof(int));
+        if (b.reg)
+                b.reg->consts = (double *) malloc(n * sizeof(double));
+        if (!b.reg || !leader || !start || !b.map || !b.dirty ||
+                        !b.reg->consts) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        b.reg->nslots = prog->max_depth;
+
+        leader[0] = 1;
+        for (int i = 0; i < n; ++i) {
+                int op = prog->insns[i].op;
+                if (cmd_is_jmp(op))
+                        leader[prog->insns[i].target] = 1;
+                if (i + 1 < n && (cmd_is_jmp(op) || !cmd_falls_through(op)))
+                        leader[i + 1] = 1;
+        }
+        for (int k = 0; k <= prog->max_depth; ++k)
+                b.map[k] = k;
+        b.acc = -1;
+
+        int open = 0;           /* the previous insn falls through */
+        for (int i = 0; i < n; ++i) {
+                const struct insn *insn = &prog->insns[i];
+                int depth = prog->depths[i];
+                if (depth < 0) {
+                        start[i] = -1;
+                        open = 0;
+                        continue;
+                }
+
+                if (leader[i])
+                        flush(&b, open ? depth : 0);
+                start[i] = b.reg->ncode;
+                translate_insn(&b, insn, depth, i);
+                open = cmd_falls_through(insn->op);
+        }
+
+        for (int j = 0; j < b.reg->ncode; ++j) {
+                struct rinsn *rinsn = &b.reg->code[j];
+                if (rop_is_jmp(rinsn->op))
+                        rinsn->target = start[rinsn->target];
+        }
+
+        prog->reg = b.reg;
+        free(b.dirty);
+        free(b.map);
+        free(start);
+        free(leader);
+}
+
+void reg_dtor(struct program *prog)
+{
+        if (!prog->reg)
+                return;
+        free(prog->reg->code);
+        free(prog->reg->consts);
+        free(prog->reg);
+        prog->reg = NULL;
+}
+
+static void translate_insn(struct reg_builder *b, const struct insn *insn,
+                int depth, int index)
+{
+        int *map = b->map;
+        int top = depth - 1;
+        int ra = 0, rb = 0;
+
+        switch (insn->op) {
+                case CMD_PUSH:
+                        map[depth] = add_const(b, insn->arg);
+                        b->dirty[b->ndirty++] = depth;
+                        break;
+                case CMD_ADD:
+                        emit_binary(b, R_ADD_AR, top - 1, map[top]);
+                        break;
+                case CMD_SUB:
+                        emit_binary(b, R_SUB_AR, top - 1, map[top]);
+                        break;
+                case CMD_MUL:
+                        emit_binary(b, R_MUL_AR, top - 1, map[top]);
+                        break;
+                case CMD_DIV:
+                        emit_binary(b, R_DIV_AR, top - 1, map[top]);
+                        break;
+                case CMD_PUSH_ADD:
+                        emit_binary(b, R_ADD_AR, top,
+                                        add_const(b, insn->arg));
+                        break;
+                case CMD_PUSH_MUL:
+                        emit_binary(b, R_MUL_AR, top,
+                                        add_const(b, insn->arg));
+                        break;
+                case CMD_SQRT:
+                case CMD_SIN:
+                case CMD_COS:
+                        ra = map[top];
+                        claim_acc(b, top, top);
+                        emit(b, R_SQRT_A + 2 * (insn->op - CMD_SQRT) +
+                                        (ra != reg_acc), 0, ra, 0, 0);
+                        map[top] = reg_acc;
+                        b->acc = top;
+                        break;
+                case CMD_SINCOS:
+                        ra = map[top];
+                        claim_acc(b, top, top);
+                        emit(b, ra == reg_acc ? R_SINCOS_A : R_SINCOS_R, top,
+                                        ra, 0, 0);
+                        map[top] = top;
+                        map[depth] = reg_acc;
+                        b->acc = depth;
+                        break;
+                case CMD_IN:
+                        claim_acc(b, -1, -1);
+                        emit(b, R_IN, 0, 0, 0, 0);
+                        map[depth] = reg_acc;
+                        b->acc = depth;
+                        break;
+                case CMD_OUT:
+                        ra = map[top];
+                        emit(b, ra == reg_acc ? R_OUT_A : R_OUT_R, 0, ra, 0,
+                                        0);
+                        break;
+                case CMD_HLT:
+                        flush(b, depth);
+                        emit(b, R_HLT, 0, 0, depth, index);
+                        break;
+                case CMD_OUT_HLT:
+                        flush(b, depth);
+                        emit(b, R_OUT_HLT, 0, top, depth, index);
+                        break;
+                case CMD_JMP:
+                        flush(b, depth);
+                        emit(b, R_JMP, 0, 0, 0, insn->target);
+                        break;
+                case CMD_JA:
+                case CMD_JAE:
+                case CMD_JB:
+                case CMD_JBE:
+                case CMD_JE:
+                case CMD_JNE:
+                        ra = map[top - 1];
+                        rb = map[top];
+                        flush(b, depth - 2);
+                        emit_jump(b, R_JA_AR + insn->op - CMD_JA, ra, rb,
+                                        insn->target);
+                        break;
+                case CMD_PUSH_JB:
+                        ra = map[top];
+                        rb = add_const(b, insn->arg);
+                        flush(b, depth - 1);
+                        emit_jump(b, R_JB_AR, ra, rb, insn->target);
+                        break;
+        }
+}
+
+/* depth = depth OP rb into the accumulator, op is the _AR variant */
+static void emit_binary(struct reg_builder *b, int op, int depth, int rb)
+{
+        int ra = b->map[depth];
+        claim_acc(b, depth, depth + 1);
+
+        if (ra == reg_acc)
+                emit(b, op, 0, 0, rb, 0);
+        else if (rb == reg_acc)
+                emit(b, op + 1, 0, ra, 0, 0);
+        else
+                emit(b, op + 2, 0, ra, rb, 0);
+
+        b->map[depth] = reg_acc;
+        b->acc = depth;
+}
+
+/*
+ * Conditional jump on ra OP rb, op is the _AR variant. With the
+ * accumulator on the right the comparison is mirrored, which gives the
+ * same result for NaNs too.
+ */
+static void emit_jump(struct reg_builder *b, int op, int ra, int rb,
+                int target)
+{
+        static const int mirror[] = {R_JB_AR, R_JBE_AR, R_JA_AR, R_JAE_AR,
+                R_JE_AR, R_JNE_AR};
+
+        if (ra == reg_acc) {
+                emit(b, op, 0, 0, rb, target);
+        } else if (rb == reg_acc) {
+                emit(b, mirror[op - R_JA_AR], 0, 0, ra, target);
+        } else {
+                emit(b, op + R_JA_RR - R_JA_AR, 0, ra, rb, target);
+        }
+}
+
+/* store the accumulator unless it holds one of the depths to be consumed */
+static void claim_acc(struct reg_builder *b, int keep1, int keep2)
+{
+        if (b->acc < 0 || b->acc == keep1 || b->acc == keep2)
+                return;
+
+        emit(b, R_STORE, b->acc, 0, 0, 0);
+        b->map[b->acc] = b->acc;
+        b->acc = -1;
+}
+
+/*
+ * Store the accumulator and constants of depths below depth into their
+ * slots, everything above is dead. Afterwards every depth maps to itself.
+ */
+static void flush(struct reg_builder *b, int depth)
+{
+        int nslots = b->reg->nslots;
+        for (int i = 0; i < b->ndirty; ++i) {
+                int k = b->dirty[i];
+                if (b->map[k] < nslots)
+                        continue;
+                if (k < depth)
+                        emit(b, R_MOV, k, b->map[k], 0, 0);
+                b->map[k] = k;
+        }
+        b->ndirty = 0;
+
+        if (b->acc >= 0) {
+                if (b->acc < depth)
+                        emit(b, R_STORE, b->acc, 0, 0, 0);
+                b->map[b->acc] = b->acc;
+                b->acc = -1;
+        }
+}
+
+static int add_const(struct reg_builder *b, double val)
+{
+        struct reg_code *reg = b->reg;
+        reg->consts[reg->nconsts] = val;
+        return reg->nslots + reg->nconsts++;
+}
+
+static void emit(struct reg_builder *b, int op, int dst, int a, int rb,
+                int target)
+{
+        struct reg_code *reg = b->reg;
+        if (reg->ncode == b->capacity) {
+                b->capacity = b->capacity ? b->capacity * 2 : 64;
+                reg->code = (struct rinsn *) realloc(reg->code,
+                                b->capacity * sizeof(struct rinsn));
+                if (!reg->code) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+        }
+
+        struct rinsn *rinsn = &reg->code[reg->ncode++];
+        rinsn->op = op;
+        rinsn->dst = dst;
+        rinsn->a = a;
+        rinsn->b = rb;
+        rinsn->target = target;
+}
+
+static int rop_is_jmp(int op)
+{
+        return op >= R_JMP && op <= R_JNE_RR;
+}
+
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+#define ROP(OP) op_##OP:
+#define RNEXT() goto *table[pc->op]
+#define RENGINE_BEGIN() RNEXT();
+#define RENGINE_END()
+#define ROP_LABEL(OP) &&op_##OP,
+#else
+#define ROP(OP) case OP:
+#define RNEXT() continue
+#define RENGINE_BEGIN() for (;;) { switch (pc->op) {
+#define RENGINE_END() } }
+#endif
+
+/* one handler per operand form, see ROPS */
+#define RBINARY(OP, NAME) ROP(NAME##_AR) {                              \
+                                  acc = acc OP r[pc->b];                \
+                                  ++pc;                                 \
+                                  RNEXT();                              \
+                          }                                             \
+                          ROP(NAME##_RA) {                              \
+                                  acc = r[pc->a] OP acc;                \
+                                  ++pc;                                 \
+                                  RNEXT();                              \
+                          }                                             \
+                          ROP(NAME##_RR) {                              \
+                                  acc = r[pc->a] OP r[pc->b];           \
+                                  ++pc;                                 \
+                                  RNEXT();                              \
+                          }
+
+#define RUNARY(FN, NAME) ROP(NAME##_A) {                                \
+                                 acc = FN(acc, fast);                   \
+                                 ++pc;                                  \
+                                 RNEXT();                               \
+                         }                                              \
+                         ROP(NAME##_R) {                                \
+                                 acc = FN(r[pc->a], fast);              \
+                                 ++pc;                                  \
+                                 RNEXT();                               \
+                         }
+
+#define RJMP(OP, NAME) ROP(NAME##_AR) {                                 \
+                               pc = acc OP r[pc->b] ? code + pc->target \
+                                       : pc + 1;                        \
+                               RNEXT();                                 \
+                       }                                                \
+                       ROP(NAME##_RR) {                                 \
+                               pc = r[pc->a] OP r[pc->b] ?              \
+                                       code + pc->target : pc + 1;      \
+                               RNEXT();                                 \
+                       }
+
+/*
+ * Only whole runs from the first instruction go through the IR: the
+ * stack is built in the register file and copied back at hlt.
+ */
+int reg_run(struct processor *processor, int flags)
+{
+        if (!processor || !processor->prog) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        const struct reg_code *reg = processor->prog->reg;
+        struct dstack *stk = &processor->stk;
+        if (!reg || processor->ip != 0 || stk->size != 0)
+                return -1;
+
+        double *r = (double *) malloc((reg->nslots + reg->nconsts + 1) *
+                        sizeof(double));
+        if (!r) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        memcpy(r + reg->nslots, reg->consts, reg->nconsts * sizeof(double));
+
+        #if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+        static const void *const table[] = {ROPS(ROP_LABEL)};
+        #endif
+
+        const struct rinsn *code = reg->code;
+        const struct rinsn *pc = code;
+        const struct proc_io *io = &processor->io;
+        int fast = (flags & PROC_FAST_MATH) != 0;
+        double acc = 0;
+
+        RENGINE_BEGIN()
+
+        ROP(R_OUT_HLT) {
+                io->out(io->out_ctx, r[pc->a]);
+                goto halt;
+        }
+        ROP(R_HLT) {
+                goto halt;
+        }
+        ROP(R_MOV) {
+                r[pc->dst] = r[pc->a];
+                ++pc;
+                RNEXT();
+        }
+        ROP(R_STORE) {
+                r[pc->dst] = acc;
+                ++pc;
+                RNEXT();
+        }
+        RBINARY(+, R_ADD)
+        RBINARY(-, R_SUB)
+        RBINARY(*, R_MUL)
+        RBINARY(/, R_DIV)
+        RUNARY(math_sqrt, R_SQRT)
+        RUNARY(math_sin, R_SIN)
+        RUNARY(math_cos, R_COS)
+        ROP(R_SINCOS_A) {
+                double s = 0, c = 0;
+                math_sincos(acc, fast, &s, &c);
+                r[pc->dst] = s;
+                acc = c;
+                ++pc;
+                RNEXT();
+        }
+        ROP(R_SINCOS_R) {
+                double s = 0, c = 0;
+                math_sincos(r[pc->a], fast, &s, &c);
+                r[pc->dst] = s;
+                acc = c;
+                ++pc;
+                RNEXT();
+        }
+        ROP(R_IN) {
+                acc = io->in(io->in_ctx);
+                ++pc;
+                RNEXT();
+        }
+        ROP(R_OUT_A) {
+                io->out(io->out_ctx, acc);
+                ++pc;
+                RNEXT();
+        }
+        ROP(R_OUT_R) {
+                io->out(io->out_ctx, r[pc->a]);
+                ++pc;
+                RNEXT();
+        }
+        ROP(R_JMP) {
+                pc = code + pc->target;
+                RNEXT();
+        }
+        RJMP(>, R_JA)
+        RJMP(>=, R_JAE)
+        RJMP(<, R_JB)
+        RJMP(<=, R_JBE)
+        RJMP(==, R_JE)
+        RJMP(!=, R_JNE)
+
+        RENGINE_END()
+
+halt:
+        dstack_reserve(stk, pc->b);
+        memcpy(stk->data, r, pc->b * sizeof(double));
+        stk->size = pc->b;
+        processor->ip = pc->target;
+        free(r);
+        return 0;
+}
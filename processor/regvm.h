@@ -0,0 +1,35 @@
+#ifndef REGVM_H
+#define REGVM_H
+
+#include "processor.h"
+
+/* three-address instruction, operands index the register file */
+struct rinsn {
+        int op;                 /* enum rop, see regvm.cpp */
+        int dst;
+        int a;
+        int b;
+        int target;             /* rinsn index of a jump, insn of a hlt */
+};
+
+/*
+ * Registers 0 .. nslots - 1 are the stack slots, the nconsts registers
+ * after them hold the pushed constants.
+ */
+struct reg_code {
+        struct rinsn *code;
+        int ncode;
+        double *consts;
+        int nconsts;
+        int nslots;
+};
+
+/* translate a verified program into prog->reg at load time */
+void reg_compile(struct program *prog);
+void reg_dtor(struct program *prog);
+
+/* run on the register IR, -1 if it has to be interpreted instead;
+ * flags are enum proc_flags, of which only PROC_FAST_MATH matters */
+int reg_run(struct processor *processor, int flags);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * runner - run many (program, input) jobs on a work-stealing thread pool
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "processor.h"
+
+/*
+ * The jobs file has one job per line: the binary and optionally a file
+ * to feed to in. Every job gets its own struct processor with out
+ * captured in memory, and failures are reported per job. Once all jobs
+ * finished the outputs are printed in job order, each after a
+ * "== <job> <program> <input>: <status>" line.
+ */
+struct job {
+        char *program;
+        char *input;            /* NULL for empty input */
+        int status;             /* enum proc_status */
+        char *output;
+        size_t output_size;
+};
+
+/* jobs of one worker: the owner pops from tail, thieves take from head */
+struct deque {
+        pthread_mutex_t lock;
+        int *jobs;
+        int head;
+        int tail;
+};
+
+struct pool {
+        struct job *jobs;
+        int njobs;
+        struct deque *deques;
+        int nthreads;
+        int flags;              /* enum proc_flags */
+};
+
+struct worker {
+        struct pool *pool;
+        int id;
+};
+
+static int read_jobs(const char *filename, struct job **jobs);
+static void run_pool(struct pool *pool);
+static void *worker_main(void *arg);
+static int deque_pop(struct deque *deque);
+static int deque_steal(struct deque *deque);
+static void run_job(struct job *job, int flags);
+static int print_jobs(const struct job *jobs, int njobs);
+
+int main(int argc, char *argv[])
+{
+        struct pool pool = {};
+        long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "jt:")) != -1) {
+                switch (opt) {
+                        case 'j':
+                                pool.flags |= PROC_JIT;
+                                break;
+                        case 't':
+                                nthreads = strtol(optarg, NULL, 10);
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-j] [-t threads] "
+                                                "jobs\n", argv[0]);
+                                exit(1);
+                }
+        }
+
+        if (optind != argc - 1) {
+                fprintf(stderr, "error: jobs file not specified\n");
+                exit(1);
+        }
+
+        pool.njobs = read_jobs(argv[optind], &pool.jobs);
+        pool.nthreads = nthreads > 0 ? nthreads : 1;
+        run_pool(&pool);
+
+        int failed = print_jobs(pool.jobs, pool.njobs);
+        for (int i = 0; i < pool.njobs; ++i) {
+                free(pool.jobs[i].program);
+                free(pool.jobs[i].input);
+                free(pool.jobs[i].output);
+        }
+        free(pool.jobs);
+        return failed ? 1 : 0;
+}
+
+static int read_jobs(const char *filename, struct job **jobs)
+{
+        FILE *file = fopen(filename, "r");
+        if (!file) {
+                fprintf(stderr, "error: couldn't open file\n");
+                exit(1);
+        }
+
+        int njobs = 0, capacity = 0;
+        char *line = NULL;
+        size_t len = 0;
+        *jobs = NULL;
+
+        while (getline(&line, &len, file) >= 0) {
+                char *save = NULL;
+                char *program = strtok_r(line, " \t\n", &save);
+                char *input = strtok_r(NULL, " \t\n", &save);
+                if (!program)
+                        continue;
+
+                if (njobs == capacity) {
+                        capacity = capacity ? capacity * 2 : 16;
+                        *jobs = (struct job *) realloc(*jobs,
+                                        capacity * sizeof(struct job));
+                        if (!*jobs) {
+                                fprintf(stderr, "error: couldn't allocate "
+                                                "memory\n");
+                                exit(1);
+                        }
+                }
+
+                struct job *job = &(*jobs)[njobs++];
+                memset(job, 0, sizeof(struct job));
+                job->program = strdup(program);
+                job->input = input ? strdup(input) : NULL;
+        }
+
+        free(line);
+        fclose(file);
+        return njobs;
+}
+
+/* deal the jobs round-robin and let idle workers steal the rest */
+static void run_pool(struct pool *pool)
+{
+        pool->deques = (struct deque *) calloc(pool->nthreads,
+                        sizeof(struct deque));
+        pthread_t *threads = (pthread_t *) calloc(pool->nthreads,
+                        sizeof(pthread_t));
+        struct worker *workers = (struct worker *) calloc(pool->nthreads,
+                        sizeof(struct worker));
+        if (!pool->deques || !threads || !workers) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        for (int t = 0; t < pool->nthreads; ++t) {
+                struct deque *deque = &pool->deques[t];
+                pthread_mutex_init(&deque->lock, NULL);
+                deque->jobs = (int *) malloc((pool->njobs / pool->nthreads + 1) *
+                                sizeof(int));
+                if (!deque->jobs) {
+                        fprintf(stderr, "error: couldn't allocate memory\n");
+                        exit(1);
+                }
+        }
+        for (int i = 0; i < pool->njobs; ++i) {
+                struct deque *deque = &pool->deques[i % pool->nthreads];
+                deque->jobs[deque->tail++] = i;
+        }
+
+        for (int t = 0; t < pool->nthreads; ++t) {
+                workers[t].pool = pool;
+                workers[t].id = t;
+                if (pthread_create(&threads[t], NULL, worker_main,
+                                        &workers[t]) != 0) {
+                        fprintf(stderr, "error: couldn't create thread\n");
+                        exit(1);
+                }
+        }
+        for (int t = 0; t < pool->nthreads; ++t)
+                pthread_join(threads[t], NULL);
+
+        for (int t = 0; t < pool->nthreads; ++t) {
+                pthread_mutex_destroy(&pool->deques[t].lock);
+                free(pool->deques[t].jobs);
+        }
+        free(pool->deques);
+        free(threads);
+        free(workers);
+}
+
+/* no job spawns new ones, so a worker is done once every deque is empty */
+static void *worker_main(void *arg)
+{
+        struct worker *worker = (struct worker *) arg;
+        struct pool *pool = worker->pool;
+
+        for (;;) {
+                int job = deque_pop(&pool->deques[worker->id]);
+                for (int t = 1; job < 0 && t < pool->nthreads; ++t)
+                        job = deque_steal(&pool->deques[(worker->id + t) %
+                                        pool->nthreads]);
+                if (job < 0)
+                        return NULL;
+
+                run_job(&pool->jobs[job], pool->flags);
+        }
+}
+
+static int deque_pop(struct deque *deque)
+{
+        int job = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail)
+                job = deque->jobs[--deque->tail];
+        pthread_mutex_unlock(&deque->lock);
+        return job;
+}
+
+static int deque_steal(struct deque *deque)
+{
+        int job = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->head < deque->tail)
+                job = deque->jobs[deque->head++];
+        pthread_mutex_unlock(&deque->lock);
+        return job;
+}
+
+static void run_job(struct job *job, int flags)
+{
+        struct program prog = {};
+        struct processor processor = {};
+
+        FILE *in = fopen(job->input ? job->input : "/dev/null", "r");
+        FILE *out = open_memstream(&job->output, &job->output_size);
+        if (!out) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+
+        if (!in)
+                job->status = PROC_ERR_OPEN;
+        else
+                job->status = program_load(&prog, job->program);
+
+        if (job->status == PROC_OK) {
+                processor_ctor(&processor, &prog);
+                processor.io.in_ctx = in;
+                processor.io.out_ctx = out;
+                job->status = processor_run(&processor, flags, -1);
+                processor_dtor(&processor);
+        }
+
+        if (in)
+                fclose(in);
+        fclose(out);
+        program_dtor(&prog);
+}
+
+/* returns the number of failed jobs */
+static int print_jobs(const struct job *jobs, int njobs)
+{
+        int failed = 0;
+        for (int i = 0; i < njobs; ++i) {
+                const struct job *job = &jobs[i];
+                printf("== %d %s %s: %s\n", i, job->program,
+                                job->input ? job->input : "-",
+                                job->status == PROC_OK ? "ok" :
+                                proc_strerror(job->status));
+                fwrite(job->output, 1, job->output_size, stdout);
+                failed += job->status != PROC_OK;
+        }
+        return failed;
+}
@@ -0,0 +1,145 @@
+/*
+ * sample - SIGPROF sampling profiler with folded-stack output
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "common.h"
+#include "processor.h"
+#include "decode.h"
+#include "sample.h"
+
+static struct sampler *active;
+
+static void on_sigprof(int);
+static void report_lines(const struct sampler *sampler,
+                const struct program *prog, FILE *out);
+static void report_insns(const struct sampler *sampler,
+                const struct program *prog, FILE *out);
+
+void sampler_ctor(struct sampler *sampler, const struct program *prog)
+{
+        if (!sampler || !prog) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        sampler->hook = NULL;
+        sampler->pending = 0;
+        sampler->insns = prog->insns;
+        sampler->ninsns = prog->ninsns;
+        sampler->hits = (uint64_t *) calloc(prog->ninsns, sizeof(uint64_t));
+        if (!sampler->hits) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        sampler->nsamples = 0;
+}
+
+void sampler_dtor(struct sampler *sampler)
+{
+        free(sampler->hits);
+        sampler->hits = NULL;
+}
+
+/* one sampler per process, the timer counts CPU time of all threads */
+void sampler_start(struct sampler *sampler)
+{
+        active = sampler;
+
+        struct sigaction sa = {};
+        sa.sa_handler = on_sigprof;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, NULL);
+
+        struct itimerval timer = {};
+        timer.it_interval.tv_usec = sample_period;
+        timer.it_value.tv_usec = sample_period;
+        setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+/* a sampler that is not the one attached has nothing to stop */
+void sampler_stop(struct sampler *sampler)
+{
+        if (active != sampler)
+                return;
+
+        struct itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, NULL);
+        signal(SIGPROF, SIG_IGN);
+        active = NULL;
+}
+
+/* samples that arrive outside the interpreter are dropped on attach */
+static void on_sigprof(int)
+{
+        struct sampler *sampler = active;
+        if (!sampler)
+                return;
+
+        sampler->pending = 1;
+        for (int i = 0; i < 256; ++i)
+                sampler->ops[i] = sampler->hook;
+}
+
+/*
+ * Folded stacks, one "frame;frame;... count" line per sampled place, as
+ * flamegraph.pl and most profile viewers read them. With a line table
+ * the frames are the source file, the label above the line and the line;
+ * without one they are the byte offset and mnemonic of the instruction.
+ */
+void sampler_report(const struct sampler *sampler,
+                const struct program *prog, FILE *out)
+{
+        if (prog->lines)
+                report_lines(sampler, prog, out);
+        else
+                report_insns(sampler, prog, out);
+}
+
+/* instructions of one line are contiguous, add them up line by line */
+static void report_lines(const struct sampler *sampler,
+                const struct program *prog, FILE *out)
+{
+        const char *file = prog->names;
+        const struct debug_line *line = NULL;
+        uint64_t hits = 0;
+
+        for (int i = 0; i <= sampler->ninsns; ++i) {
+                const struct debug_line *at = i < sampler->ninsns ?
+                        find_line(prog, prog->offsets[i]) : NULL;
+                if (i < sampler->ninsns && at == line) {
+                        hits += sampler->hits[i];
+                        continue;
+                }
+
+                if (hits && line)
+                        fprintf(out, "%s;%s;%s:%u %llu\n", file,
+                                        line->label != debug_nolabel ?
+                                        prog->names + line->label : "-",
+                                        file, line->line,
+                                        (unsigned long long) hits);
+                else if (hits)
+                        fprintf(out, "%s;-;%s %llu\n", file, file,
+                                        (unsigned long long) hits);
+
+                line = at;
+                hits = i < sampler->ninsns ? sampler->hits[i] : 0;
+        }
+}
+
+static void report_insns(const struct sampler *sampler,
+                const struct program *prog, FILE *out)
+{
+        for (int i = 0; i < sampler->ninsns; ++i) {
+                if (!sampler->hits[i])
+                        continue;
+                fprintf(out, "%04x:%s %llu\n", prog->offsets[i],
+                                cmd_names[sampler->insns[i].op],
+                                (unsigned long long) sampler->hits[i]);
+        }
+}
@@ -0,0 +1,66 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include "processor.h"
+
+/* SIGPROF period in microseconds of CPU time */
+const long sample_period = 1000;
+
+/*
+ * Statistical profile at no cost per instruction. The threaded engine
+ * dispatches through ops, which sampler_attach() fills with its own
+ * handlers. The SIGPROF handler raises pending and points every entry
+ * at the engine's sample label, so the next dispatch lands there: it
+ * counts a hit for the insn about to run and puts the handlers back
+ * with sampler_restore(). The switch engine has no table to patch and
+ * takes pending samples in its per-instruction hook instead.
+ */
+struct sampler {
+        const void *volatile ops[256];
+        const void *volatile hook;      /* label every entry is patched to */
+        volatile sig_atomic_t pending;  /* a sample is due */
+        const struct insn *insns;
+        int ninsns;
+        uint64_t *hits;
+        uint64_t nsamples;
+};
+
+void sampler_ctor(struct sampler *sampler, const struct program *prog);
+void sampler_dtor(struct sampler *sampler);
+void sampler_start(struct sampler *sampler);
+void sampler_stop(struct sampler *sampler);
+void sampler_report(const struct sampler *sampler,
+                const struct program *prog, FILE *out);
+
+/* called by the engine on entry, returns the table to dispatch through */
+static inline const void *volatile *sampler_attach(struct sampler *sampler,
+                const void *const *dispatch, const void *hook)
+{
+        sampler->hook = hook;
+        for (int i = 0; i < 256; ++i)
+                sampler->ops[i] = dispatch[i];
+        sampler->pending = 0;
+        return sampler->ops;
+}
+
+static inline void sampler_restore(struct sampler *sampler,
+                const void *const *dispatch)
+{
+        for (int i = 0; i < 256; ++i)
+                sampler->ops[i] = dispatch[i];
+}
+
+/* count a hit for insn ip if a sample is due */
+static inline void sampler_take(struct sampler *sampler, int ip)
+{
+        if (!sampler->pending)
+                return;
+        sampler->pending = 0;
+        ++sampler->hits[ip];
+        ++sampler->nsamples;
+}
+
+#endif
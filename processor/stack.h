@@ -1,18 +1,114 @@
 #ifndef STACK_H
 #define STACK_H
 
-struct stack {
-        void *data;
-        size_t elm_size;
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#endif
+#include "common.h"
+
+/* contiguous stack of doubles used as the processor operand stack */
+struct dstack {
+        double *data;
         int capacity;
         int size;
 };
 
-void stack_ctor(struct stack *stk, const int capacity, const size_t elm_size);
-void stack_dtor(struct stack *stk);
+void dstack_ctor(struct dstack *stk, const int capacity);
+void dstack_dtor(struct dstack *stk);
+void dstack_grow(struct dstack *stk);
+void dstack_reserve(struct dstack *stk, int capacity);
+void dstack_peek(struct dstack *stk, FILE *out);
+
+static inline void dstack_push(struct dstack *stk, double elm)
+{
+        if (stk->size >= stk->capacity)
+                dstack_grow(stk);
+        stk->data[stk->size++] = elm;
+}
+
+/* pop on an empty stack yields 0 and leaves the stack unchanged */
+static inline double dstack_pop(struct dstack *stk)
+{
+        if (stk->size <= 0)
+                return 0;
+        return stk->data[--stk->size];
+}
+
+/* slots are untyped: the int64 instructions use the same 64 bits */
+static inline int64_t slot_int(double slot)
+{
+        int64_t val = 0;
+        memcpy(&val, &slot, sizeof(val));
+        return val;
+}
+
+static inline double int_slot(int64_t val)
+{
+        double slot = 0;
+        memcpy(&slot, &val, sizeof(slot));
+        return slot;
+}
+
+/*
+ * The common.h int_ functions on slots. Add and subtract stay in the
+ * vector unit where there is one: moving a slot from an xmm register to
+ * a general one and back takes longer than the operation.
+ */
+static inline double slot_iadd(double b, double a)
+{
+#if defined(__x86_64__) || defined(__i386__)
+        return _mm_cvtsd_f64(_mm_castsi128_pd(_mm_add_epi64(
+                                        _mm_castpd_si128(_mm_set_sd(b)),
+                                        _mm_castpd_si128(_mm_set_sd(a)))));
+#else
+        return int_slot(int_add(slot_int(b), slot_int(a)));
+#endif
+}
+
+static inline double slot_isub(double b, double a)
+{
+#if defined(__x86_64__) || defined(__i386__)
+        return _mm_cvtsd_f64(_mm_castsi128_pd(_mm_sub_epi64(
+                                        _mm_castpd_si128(_mm_set_sd(b)),
+                                        _mm_castpd_si128(_mm_set_sd(a)))));
+#else
+        return int_slot(int_sub(slot_int(b), slot_int(a)));
+#endif
+}
+
+/* itof and ftoi, cvttsd2si already gives int_from_double()'s INT64_MIN */
+static inline double slot_itof(double a)
+{
+#if defined(__x86_64__)
+        return _mm_cvtsd_f64(_mm_cvtsi64_sd(_mm_setzero_pd(),
+                                _mm_cvtsi128_si64(_mm_castpd_si128(
+                                                _mm_set_sd(a)))));
+#else
+        return (double) slot_int(a);
+#endif
+}
+
+static inline double slot_ftoi(double a)
+{
+#if defined(__x86_64__)
+        return _mm_cvtsd_f64(_mm_castsi128_pd(_mm_cvtsi64_si128(
+                                        _mm_cvttsd_si64(_mm_set_sd(a)))));
+#else
+        return int_slot(int_from_double(a));
+#endif
+}
+
+static inline double slot_imul(double b, double a)
+{
+        return int_slot(int_mul(slot_int(b), slot_int(a)));
+}
 
-void stack_push(struct stack *stk, void *elm);
-void stack_pop(struct stack *stk, void *elm);
-void stack_peek(struct stack *stk);
+static inline double slot_idiv(double b, double a)
+{
+        return int_slot(int_div(slot_int(b), slot_int(a)));
+}
 
 #endif
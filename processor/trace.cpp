@@ -0,0 +1,110 @@
+/*
+ * trace - binary execution trace through a ring buffer, see trace.h
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include "processor.h"
+#include "trace.h"
+
+static void *writer_main(void *arg);
+static void write_records(struct trace *trace, uint64_t from, uint64_t to);
+
+void trace_ctor(struct trace *trace, const char *filename)
+{
+        if (!trace || !filename) {
+                fprintf(stderr, "error: null pointer\n");
+                exit(1);
+        }
+
+        trace->file = fopen(filename, "wb");
+        if (!trace->file) {
+                fprintf(stderr, "error: couldn't open file\n");
+                exit(1);
+        }
+        struct trace_header header = {trace_signature, trace_version};
+        fwrite(&header, sizeof(header), 1, trace->file);
+
+        trace->ring = (struct trace_record *) calloc(trace_capacity,
+                        sizeof(struct trace_record));
+        if (!trace->ring) {
+                fprintf(stderr, "error: couldn't allocate memory\n");
+                exit(1);
+        }
+        trace->head = 0;
+        trace->tail_seen = 0;
+        trace->tail = 0;
+        trace->done = 0;
+
+        if (pthread_create(&trace->writer, NULL, writer_main, trace)) {
+                fprintf(stderr, "error: couldn't start thread\n");
+                exit(1);
+        }
+}
+
+/* drains what is left, the engine must not append any more */
+void trace_dtor(struct trace *trace)
+{
+        __atomic_store_n(&trace->done, 1, __ATOMIC_RELEASE);
+        pthread_join(trace->writer, NULL);
+
+        if (fclose(trace->file)) {
+                fprintf(stderr, "error: couldn't write file\n");
+                exit(1);
+        }
+        free(trace->ring);
+        trace->ring = NULL;
+        trace->file = NULL;
+}
+
+/* the ring is full: wait until the writer frees some of it */
+void trace_wait(struct trace *trace)
+{
+        for (;;) {
+                trace->tail_seen = __atomic_load_n(&trace->tail,
+                                __ATOMIC_ACQUIRE);
+                if (trace->head - trace->tail_seen < trace_capacity)
+                        return;
+                sched_yield();
+        }
+}
+
+static void *writer_main(void *arg)
+{
+        struct trace *trace = (struct trace *) arg;
+        struct timespec nap = {0, 100000};
+
+        for (;;) {
+                /* done first: every record appended before it is seen */
+                int done = __atomic_load_n(&trace->done, __ATOMIC_ACQUIRE);
+                uint64_t head = __atomic_load_n(&trace->head,
+                                __ATOMIC_ACQUIRE);
+                if (head == trace->tail) {
+                        if (done)
+                                return NULL;
+                        nanosleep(&nap, NULL);
+                        continue;
+                }
+
+                write_records(trace, trace->tail, head);
+                __atomic_store_n(&trace->tail, head, __ATOMIC_RELEASE);
+        }
+}
+
+/* records from .. to - 1, in at most two pieces around the wrap */
+static void write_records(struct trace *trace, uint64_t from, uint64_t to)
+{
+        uint64_t mask = trace_capacity - 1;
+        uint64_t first = to - from;
+        if ((from & mask) + first > trace_capacity)
+                first = trace_capacity - (from & mask);
+
+        fwrite(&trace->ring[from & mask], sizeof(struct trace_record), first,
+                        trace->file);
+        if (first < to - from)
+                fwrite(trace->ring, sizeof(struct trace_record),
+                                to - from - first, trace->file);
+}
@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "processor.h"
+
+/* records in the ring, a power of two */
+const uint64_t trace_capacity = 1 << 16;
+
+/* one executed instruction, as written to the trace file */
+struct trace_record {
+        uint32_t offset;        /* byte offset of the insn */
+        uint8_t op;             /* enum cmd */
+        uint8_t reserved;
+        uint16_t depth;         /* stack depth before it, saturated */
+        double tos;             /* top slot before it, 0 if empty; an int64
+                                   slot is stored as its bits */
+};
+
+static_assert(sizeof(struct trace_record) == 16,
+                "trace records are 16 bytes on disk");
+
+/* the trace file is this header and the records in execution order */
+struct trace_header {
+        uint32_t signature;
+        uint32_t v;
+};
+
+const uint32_t trace_signature = 0x637274;
+const uint32_t trace_version = 1;
+
+/*
+ * Single producer ring buffer without locks: the engine appends at head,
+ * a writer thread drains up to head into the file and advances tail.
+ * Both sides only publish their own index, with release stores, and
+ * live on separate cache lines. A full ring makes the engine wait for
+ * the writer, so no record is ever dropped.
+ */
+struct trace {
+        struct trace_record *ring;
+        FILE *file;
+        pthread_t writer;
+
+        alignas(64) uint64_t head;      /* records appended */
+        uint64_t tail_seen;             /* tail as last read by the engine */
+
+        alignas(64) uint64_t tail;      /* records written out */
+        int done;
+};
+
+void trace_ctor(struct trace *trace, const char *filename);
+void trace_dtor(struct trace *trace);
+void trace_wait(struct trace *trace);
+
+/* called by the engine before executing the insn at offset */
+static inline void trace_step(struct trace *trace, int offset, int op,
+                int depth, double tos)
+{
+        uint64_t head = trace->head;
+        if (head - trace->tail_seen >= trace_capacity)
+                trace_wait(trace);
+
+        struct trace_record *rec = &trace->ring[head & (trace_capacity - 1)];
+        rec->offset = offset;
+        rec->op = op;
+        rec->reserved = 0;
+        rec->depth = depth < UINT16_MAX ? depth : UINT16_MAX;
+        rec->tos = depth ? tos : 0;
+        __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#endif
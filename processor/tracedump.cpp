@@ -0,0 +1,106 @@
+/*
+ * tracedump - print a binary trace written by processor -t
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "processor.h"
+#include "decode.h"
+#include "trace.h"
+
+static void print_record(const struct trace_record *rec, uint64_t n,
+                const struct program *prog);
+
+/*
+ * One line per executed instruction: its number, byte offset, mnemonic,
+ * stack depth and top of stack before it ran. Slots are untyped, so the
+ * top is printed both as a double and as its raw 64 bits, which is how
+ * an int64 reads. Given the binary with a line table (-b), the source
+ * line and label are printed as well.
+ */
+int main(int argc, char *argv[])
+{
+        const char *binary = NULL;
+        int opt = 0;
+
+        while ((opt = getopt(argc, argv, "b:")) != -1) {
+                switch (opt) {
+                        case 'b':
+                                binary = optarg;
+                                break;
+                        default:
+                                fprintf(stderr, "usage: %s [-b binary] "
+                                                "trace\n", argv[0]);
+                                exit(1);
+                }
+        }
+
+        if (optind != argc - 1) {
+                fprintf(stderr, "error: trace file not specified\n");
+                exit(1);
+        }
+
+        struct program prog = {};
+        if (binary) {
+                int status = program_load(&prog, binary);
+                if (status != PROC_OK) {
+                        fprintf(stderr, "error: %s\n", proc_strerror(status));
+                        exit(1);
+                }
+        }
+
+        FILE *in = fopen(argv[optind], "rb");
+        if (!in) {
+                fprintf(stderr, "error: couldn't open file\n");
+                exit(1);
+        }
+
+        struct trace_header header = {};
+        if (fread(&header, sizeof(header), 1, in) != 1 ||
+                        header.signature != trace_signature ||
+                        header.v != trace_version) {
+                fprintf(stderr, "error: unknown file format\n");
+                exit(1);
+        }
+
+        struct trace_record recs[4096];
+        uint64_t n = 0;
+        size_t got = 0;
+        while ((got = fread(recs, sizeof(recs[0]), 4096, in)) > 0)
+                for (size_t i = 0; i < got; ++i)
+                        print_record(&recs[i], n++, binary ? &prog : NULL);
+
+        fclose(in);
+        if (binary)
+                program_dtor(&prog);
+        return 0;
+}
+
+static void print_record(const struct trace_record *rec, uint64_t n,
+                const struct program *prog)
+{
+        const char *name = rec->op < CMD_COUNT ? cmd_names[rec->op] : "?";
+
+        printf("%10llu  %04x  %-8s  %5u", (unsigned long long) n,
+                        rec->offset, name, rec->depth);
+        if (rec->depth) {
+                uint64_t bits = 0;
+                memcpy(&bits, &rec->tos, sizeof(bits));
+                printf("  %14lg  %016llx", rec->tos,
+                                (unsigned long long) bits);
+        } else {
+                printf("  %14s  %16s", "-", "-");
+        }
+
+        const struct debug_line *line = prog && prog->lines ?
+                find_line(prog, rec->offset) : NULL;
+        if (line && line->label != debug_nolabel)
+                printf("  %s:%u %s", prog->names, line->line,
+                                prog->names + line->label);
+        else if (line)
+                printf("  %s:%u", prog->names, line->line);
+        printf("\n");
+}
@@ -0,0 +1,123 @@
+/*
+ * fastio_test - number formatting of fastio against printf and strtod
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "fastio.h"
+
+static int failures = 0;
+
+static void check_string(double val, int shortest, const char *want);
+static void check_shortest(double val);
+static void check_g(double val);
+static double random_double(uint64_t mask);
+
+int main(void)
+{
+        check_string(5e-324, 1, "5e-324");
+        check_string(-5e-324, 1, "-5e-324");
+        check_string(1.5e-323, 1, "1.5e-323");
+        check_string(2.2250738585072014e-308, 1, "2.2250738585072014e-308");
+        check_string(1.7976931348623157e308, 1, "1.7976931348623157e+308");
+        check_string(0.1, 1, "0.1");
+        check_string(0.3, 1, "0.3");
+        check_string(0.1 + 0.2, 1, "0.30000000000000004");
+        check_string(1.0 / 3, 1, "0.3333333333333333");
+        check_string(123.456, 1, "123.456");
+        check_string(1e23, 1, "1e+23");
+        check_string(0x1p53, 1, "9007199254740992");
+        check_string(1.0 / 3, 0, "0.333333");
+        check_string(5e-324, 0, "4.94066e-324");
+
+        srand48(3);
+        for (int i = 0; i < 200000; ++i) {
+                check_shortest(random_double(~0ULL));
+                check_shortest(random_double((1ULL << 52) - 1));
+                check_g(random_double(~0ULL));
+        }
+        for (int e = -1074; e <= 1023; ++e) {
+                check_shortest(ldexp(1, e));
+                check_g(ldexp(1, e));
+        }
+
+        if (failures) {
+                printf("fastio_test: %d failures\n", failures);
+                return 1;
+        }
+        return 0;
+}
+
+static void check_string(double val, int shortest, const char *want)
+{
+        char buf[fastio_maxlen] = "";
+        buf[fastio_format(buf, val, shortest)] = '\0';
+        if (strcmp(buf, want) != 0) {
+                printf("%a: got %s, want %s\n", val, buf, want);
+                ++failures;
+        }
+}
+
+/* reads back exactly, and no fewer significant digits would */
+static void check_shortest(double val)
+{
+        if (isnan(val) || isinf(val))
+                return;
+
+        char buf[fastio_maxlen] = "";
+        int len = fastio_format(buf, val, 1);
+        buf[len] = '\0';
+
+        double back = 0;
+        if (fastio_parse(buf, buf + len, &back) != len || back != val ||
+                        strtod(buf, NULL) != val) {
+                printf("%a: %s does not read back\n", val, buf);
+                ++failures;
+                return;
+        }
+
+        int digits = 0;
+        for (const char *p = buf; *p && *p != 'e'; ++p)
+                if (*p >= '0' && *p <= '9' && (digits || *p != '0'))
+                        ++digits;
+        /* integers are printed in full, trailing zeros count */
+        if (!strchr(buf, '.') && !strchr(buf, 'e'))
+                return;
+
+        for (int prec = 1; prec < digits; ++prec) {
+                char tmp[64] = "";
+                snprintf(tmp, sizeof(tmp), "%.*g", prec, val);
+                if (strtod(tmp, NULL) == val) {
+                        printf("%a: %s, but %s reads back too\n", val, buf,
+                                        tmp);
+                        ++failures;
+                        return;
+                }
+        }
+}
+
+/* without -r, output is what printf("%lg") gives */
+static void check_g(double val)
+{
+        char buf[fastio_maxlen] = "";
+        char want[64] = "";
+        buf[fastio_format(buf, val, 0)] = '\0';
+        snprintf(want, sizeof(want), "%lg", val);
+        if (strcmp(buf, want) != 0) {
+                printf("%a: got %s, want %s\n", val, buf, want);
+                ++failures;
+        }
+}
+
+/* random bits under mask, the rest zero: ~0 for any double */
+static double random_double(uint64_t mask)
+{
+        uint64_t bits = ((uint64_t) mrand48() << 32 ^
+                        (uint32_t) mrand48()) & mask;
+        double val = 0;
+        memcpy(&val, &bits, sizeof(val));
+        return val;
+}
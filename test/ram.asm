@@ -0,0 +1,40 @@
+push 3
+pop rbx
+push 42
+pop [rbx+10]
+push [13]
+out
+push [ rbx - 3 ]
+out
+push 0
+pop rax
+fill:
+in
+pop [rax+100]
+push rax
+push 1
+add
+pop rax
+push rax
+push 5
+jb fill
+push 0
+pop rcx
+push 0
+sum:
+push [rcx+100]
+add
+push rcx
+push 1
+add
+pop rcx
+push rcx
+push 5
+jb sum
+out
+ipush 7
+itof
+pop rdx
+push [rdx+6]
+out
+hlt